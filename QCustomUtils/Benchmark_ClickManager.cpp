@@ -0,0 +1,178 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+// Micro-benchmark of QClickManager hit testing, per number of clickable rectangles:
+// - linear: scan of all rectangles per event (previous implementation), as reference
+// - hover: mouse move events with hover enabled
+// - press: mouse press and release (click) events
+//
+// Rectangles are laid out in a grid (like the cells of a QTopMenuGrid), the cursor sweeps them.
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include <QApplication>
+#include <QMouseEvent>
+#include <QWidget>
+
+#include "QClickManager.hpp"
+
+using namespace Escain;
+
+namespace
+{
+/// Average time in microseconds of fct, repeated during about 200ms
+double measureUs( const std::function<void()>& fct)
+{
+	using Clock = std::chrono::steady_clock;
+	fct(); // Warm up
+
+	size_t iterations = 0;
+	const auto start = Clock::now();
+	auto now = start;
+	while (now - start < std::chrono::milliseconds(200))
+	{
+		fct();
+		++iterations;
+		now = Clock::now();
+	}
+	return std::chrono::duration<double, std::micro>(now - start).count() / iterations;
+}
+
+constexpr int CELL_SIZE = 20;
+
+/// count rectangles in a square grid, with a small gap among them
+std::vector<QRect> gridRectangles( size_t count)
+{
+	int side = 1;
+	while (static_cast<size_t>(side*side) < count)
+	{
+		++side;
+	}
+
+	std::vector<QRect> rects;
+	rects.reserve(count);
+	for (size_t i=0; i<count; ++i)
+	{
+		const int column = static_cast<int>(i)%side;
+		const int row = static_cast<int>(i)/side;
+		rects.emplace_back(column*CELL_SIZE, row*CELL_SIZE, CELL_SIZE-2, CELL_SIZE-2);
+	}
+	return rects;
+}
+
+/// Cursor positions sweeping the rectangles
+std::vector<QPoint> sweep( const std::vector<QRect>& rects)
+{
+	std::vector<QPoint> points;
+	const size_t step = std::max<size_t>(1, rects.size()/64);
+	for (size_t i=0; i<rects.size(); i+=step)
+	{
+		points.push_back(rects[i].center());
+	}
+	return points;
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+
+	std::cout << std::setw(8) << "rects" << std::setw(14) << "linear(us)" <<
+		std::setw(14) << "hover(us)" << std::setw(14) << "press(us)" << std::endl;
+
+	for (const size_t count: {10u, 100u, 1000u, 10000u})
+	{
+		const auto rects = gridRectangles(count);
+		const auto points = sweep(rects);
+
+		QWidget widget;
+		const QRect bounds = rects.front().united(rects.back());
+		widget.resize(bounds.right()+CELL_SIZE, bounds.bottom()+CELL_SIZE);
+
+		QClickManager clicker;
+		std::unordered_map<size_t, QRect> reference;
+		for (size_t i=0; i<rects.size(); ++i)
+		{
+			clicker.addClickableRectangle(i, rects[i]);
+			reference.emplace(i, rects[i]);
+		}
+		clicker.enableHover(widget);
+
+		size_t hoverCount = 0;
+		QObject::connect(&clicker, &QClickManager::hovered, [&hoverCount](const QPoint&, bool, size_t,
+			const QRect&)
+		{
+			++hoverCount;
+		});
+
+		// Previous implementation: each rectangle clipped to the widget, for each event
+		size_t found = 0;
+		const QRect widgetRect(QPoint(0,0), widget.size());
+		const double linearUs = measureUs([&]()
+		{
+			for (const auto& point: points)
+			{
+				for (const auto& p: reference)
+				{
+					found += p.second.intersected(widgetRect).contains(point) ? 1 : 0;
+				}
+			}
+		}) / points.size();
+
+		const double hoverUs = measureUs([&]()
+		{
+			for (const auto& point: points)
+			{
+				QMouseEvent move(QEvent::MouseMove, point, Qt::NoButton, Qt::NoButton, Qt::NoModifier);
+				clicker.eventHandler(&move);
+			}
+		}) / points.size();
+
+		clicker.disableHover();
+		const double pressUs = measureUs([&]()
+		{
+			for (const auto& point: points)
+			{
+				QMouseEvent press(QEvent::MouseButtonPress, point, Qt::LeftButton, Qt::LeftButton,
+					Qt::NoModifier);
+				clicker.eventHandler(&press);
+				QMouseEvent release(QEvent::MouseButtonRelease, point, Qt::LeftButton, Qt::NoButton,
+					Qt::NoModifier);
+				clicker.eventHandler(&release);
+			}
+		}) / points.size();
+
+		std::cout << std::setw(8) << count << std::fixed << std::setprecision(3) <<
+			std::setw(14) << linearUs << std::setw(14) << hoverUs << std::setw(14) << pressUs <<
+			std::endl;
+
+		if (found == 0 || hoverCount == 0)
+		{
+			std::cerr << "Unexpected: no rectangle hit" << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -18,11 +18,79 @@
 
 #include "QClickManager.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include <QDebug> //TODO remove
 
 namespace Escain
 {
 
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+bool QClickIdSet::contains( size_t id) const
+{
+	return std::find(begin(), end(), id) != end();
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+bool QClickIdSet::insert( size_t id)
+{
+	if (contains(id))
+	{
+		return false;
+	}
+	if (!m_spilled && m_size == INLINE_CAPACITY)
+	{
+		m_overflow.assign(m_inline.begin(), m_inline.end());
+		m_spilled = true;
+	}
+	if (m_spilled)
+	{
+		m_overflow.push_back(id);
+	}
+	else
+	{
+		m_inline[m_size] = id;
+	}
+	++m_size;
+	return true;
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+bool QClickIdSet::erase( size_t id)
+{
+	const auto it = std::find(begin(), end(), id);
+	if (it == end())
+	{
+		return false;
+	}
+	erase(it);
+	return true;
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+QClickIdSet::const_iterator QClickIdSet::erase( const_iterator it)
+{
+	assert(it >= begin() && it < end());
+	// Order is not kept: move the last id in place
+	size_t* ids = data();
+	ids[it-begin()] = ids[m_size-1];
+	--m_size;
+	if (m_spilled)
+	{
+		m_overflow.pop_back();
+	}
+	return it;
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+void QClickIdSet::clear()
+{
+	m_overflow.clear();
+	m_spilled = false;
+	m_size = 0;
+}
+
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 int QClickManager::threshold( int newValue )
 {
@@ -64,25 +132,53 @@ bool QClickManager::isHoverEnabled() const
 	return nullptr!=m_hoverWidget;
 }
 
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+bool QClickManager::batchedHover() const
+{
+	return m_batchedHover;
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+bool QClickManager::batchedHover( bool batch )
+{
+	m_batchedHover = batch;
+	return m_batchedHover;
+}
+
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 void QClickManager::addClickableRectangle( size_t id, const QRect& r)
 {
-	m_clickableRectangles.insert(std::make_pair(id, r));
+	const auto it = std::lower_bound(m_clickableRectangles.begin(), m_clickableRectangles.end(), id,
+		[](const ClickableRectangle& c, size_t v){ return c.id < v; });
+	if (it != m_clickableRectangles.end() && it->id == id)
+	{
+		it->rect = r;
+	}
+	else
+	{
+		m_clickableRectangles.insert(it, ClickableRectangle{id, r});
+	}
+	invalidateGrid();
 }
 
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 void QClickManager::removeClickableRectangle( size_t id)
 {
-	m_clickableRectangles.erase(id);
+	const auto* found = findRectangle(id);
+	if (found)
+	{
+		m_clickableRectangles.erase(m_clickableRectangles.begin() + (found-m_clickableRectangles.data()));
+		invalidateGrid();
+	}
 }
 
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 std::unordered_set<size_t> QClickManager::getAllClickableRectangleIds() const
 {
 	std::unordered_set<size_t> ids;
-	for (const auto& p: m_clickableRectangles)
+	for (const auto& c: m_clickableRectangles)
 	{
-		ids.insert(p.first);
+		ids.insert(c.id);
 	}
 	return ids;
 }
@@ -90,10 +186,11 @@ std::unordered_set<size_t> QClickManager::getAllClickableRectangleIds() const
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 void QClickManager::clickableRectangleById( size_t id, const QRect& r)
 {
-	auto it = m_clickableRectangles.find(id);
-	if (it != m_clickableRectangles.cend())
+	const auto* found = findRectangle(id);
+	if (found)
 	{
-		it->second = r;
+		m_clickableRectangles[static_cast<size_t>(found-m_clickableRectangles.data())].rect = r;
+		invalidateGrid();
 		return;
 	}
 	
@@ -104,16 +201,28 @@ void QClickManager::clickableRectangleById( size_t id, const QRect& r)
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 const QRect& QClickManager::clickableRectangleById( size_t id) const
 {
-	auto it = m_clickableRectangles.find(id);
-	if (it != m_clickableRectangles.cend())
+	const auto* found = findRectangle(id);
+	if (found)
 	{
-		return it->second;
+		return found->rect;
 	}
 	
 	// not found
 	throw std::out_of_range("Provided 'id' not found.");
 }
 
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+const QClickManager::ClickableRectangle* QClickManager::findRectangle( size_t id) const
+{
+	const auto it = std::lower_bound(m_clickableRectangles.cbegin(), m_clickableRectangles.cend(), id,
+		[](const ClickableRectangle& c, size_t v){ return c.id < v; });
+	if (it == m_clickableRectangles.cend() || it->id != id)
+	{
+		return nullptr;
+	}
+	return &*it;
+}
+
 //*////////////////////////////////////////////////////////////////////////////////////////////////
 bool QClickManager::eventHandler( QEvent* e )
 {
@@ -205,16 +314,15 @@ bool QClickManager::eventHandler( QEvent* e )
 			return false;
 		}
 
-		// Reset the list of containing rectangles
+		// Reset the list of containing rectangles, only those near the cursor can contain it
+		QPoint cursorPos = mouseEvent->pos();
 		m_candidateRectanglesForClick.clear();
-		m_candidateRectanglesForClick.reserve( m_clickableRectangles.size());
-		for ( auto it: m_clickableRectangles )
+		for ( const size_t index: rectanglesNear(cursorPos) )
 		{
-			m_candidateRectanglesForClick.insert(it.first);
+			m_candidateRectanglesForClick.insert(m_clickableRectangles[index].id);
 		}
 		
 		// Filter those containig the cursor position
-		QPoint cursorPos = mouseEvent->pos();
 		filterRectanglesContainingTheClick( cursorPos );
 		m_mousePressPosition = cursorPos;
 
@@ -243,26 +351,27 @@ void QClickManager::manageHover( const QPoint& curPos, bool isLeave )
 {
 
 	assert(m_hoverWidget);
-	const auto widSize = m_hoverWidget->size();
+	const bool inWidget = QRect(QPoint(0,0), m_hoverWidget->size()).contains(curPos);
 
-	// first un-hover then, hover.
-	for (auto it = m_clickableRectangles.begin(); it!=m_clickableRectangles.cend(); ++it)
+	// first un-hover then, hover. Only hovered rectangles can lose the hover.
+	for (auto hoveredIt = m_hoveredRectangles.begin(); hoveredIt!=m_hoveredRectangles.end();
+		/*increase in loop*/)
 	{
-		const auto& rect = it->second.intersected(QRect(QPoint(0,0), widSize));
-
-		if (isLeave || !(rect.contains(curPos)))
+		const size_t id = *hoveredIt;
+		const auto* found = findRectangle(id);
+		if (found && (isLeave || !inWidget || !found->rect.contains(curPos)))
 		{
-			auto hoveredIt = m_hoveredRectangles.find(it->first);
-			if (hoveredIt != m_hoveredRectangles.cend())
+			//hover end
+			hoveredIt = m_hoveredRectangles.erase(hoveredIt);
+			if (m_enabled)
 			{
-				//hover end
-				m_hoveredRectangles.erase(hoveredIt);
-				if (m_enabled)
-				{
-					emit hovered(curPos, false, it->first, it->second);
-				}
+				notifyHover(curPos, false, id, found->rect);
 			}
 		}
+		else
+		{
+			++hoveredIt;
+		}
 	}
 	// Manage un-hover when clickable rectangle list is empty -> use the full widget rectangle
 	if (m_hoveredNoRectangles && (!m_hoverWidget->rect().contains(curPos) || isLeave) )
@@ -271,25 +380,26 @@ void QClickManager::manageHover( const QPoint& curPos, bool isLeave )
 		m_hoveredNoRectangles = false;
 		if(m_clickableRectangles.empty()) // avoid to send events if a click rectangle is registered in the while
 		{
-			emit hovered(curPos, false, std::numeric_limits<size_t>::max(), m_hoverWidget->rect());
+			notifyHover(curPos, false, std::numeric_limits<size_t>::max(), m_hoverWidget->rect());
 		}
 	}
 
 	if (!isLeave)
 	{
-		for (auto it = m_clickableRectangles.begin(); it!=m_clickableRectangles.cend(); ++it)
+		const auto& nearIndexes = rectanglesNear(curPos);
+		for (size_t i=0; inWidget && i<nearIndexes.size(); ++i)
 		{
-			const auto& rect = it->second.intersected(QRect(QPoint(0,0), widSize));
-
+			const size_t id = m_clickableRectangles[nearIndexes[i]].id;
+			const QRect& rect = m_clickableRectangles[nearIndexes[i]].rect;
 			if (rect.contains(curPos))
 			{
-				if (m_hoveredRectangles.find(it->first) == m_hoveredRectangles.cend())
+				if (!m_hoveredRectangles.contains(id))
 				{
 					//hover begin
 					if (m_enabled)
 					{
-						m_hoveredRectangles.emplace(it->first);
-						emit hovered(curPos, true, it->first, it->second);
+						m_hoveredRectangles.insert(id);
+						notifyHover(curPos, true, id, rect);
 					}
 				}
 			}
@@ -304,11 +414,128 @@ void QClickManager::manageHover( const QPoint& curPos, bool isLeave )
 				if (m_enabled)
 				{
 					m_hoveredNoRectangles = true;
-					emit hovered(curPos, true, std::numeric_limits<size_t>::max(), m_hoverWidget->rect());
+					notifyHover(curPos, true, std::numeric_limits<size_t>::max(), m_hoverWidget->rect());
 				}
 			}
 		}
 	}
+
+	flushHover(curPos);
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+void QClickManager::notifyHover( const QPoint& cursorPos, bool hover, size_t id, const QRect& rect )
+{
+	if (!m_batchedHover)
+	{
+		emit hovered(cursorPos, hover, id, rect);
+		return;
+	}
+
+	if (hover)
+	{
+		m_hoverEntered.insert(id);
+	}
+	else
+	{
+		m_hoverLeft.insert(id);
+	}
+	m_hoverChangedRect = m_hoverChangedRect.united(rect);
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+void QClickManager::flushHover( const QPoint& cursorPos )
+{
+	if (m_hoverEntered.empty() && m_hoverLeft.empty())
+	{
+		return;
+	}
+
+	// Reset before emitting: the receiver may trigger another hover event
+	const QClickIdSet entered = m_hoverEntered;
+	const QClickIdSet left = m_hoverLeft;
+	const QRect changedRect = m_hoverChangedRect;
+	m_hoverEntered.clear();
+	m_hoverLeft.clear();
+	m_hoverChangedRect = QRect();
+	emit hoverChanged(cursorPos, entered, left, changedRect);
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+void QClickManager::invalidateGrid()
+{
+	m_gridDirty = true;
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+void QClickManager::updateGrid()
+{
+	if (!m_gridDirty)
+	{
+		return;
+	}
+	m_gridDirty = false;
+
+	m_gridBounds = QRect();
+	for (const auto& c: m_clickableRectangles)
+	{
+		m_gridBounds = m_gridBounds.united(c.rect.normalized());
+	}
+	for (auto& cell: m_gridCells)
+	{
+		cell.clear(); // Keep the capacity for the next rebuild
+	}
+
+	if (m_gridBounds.isEmpty())
+	{
+		m_gridColumns = 0;
+		return;
+	}
+
+	// About one cell per area, with the aspect ratio of the bounds (e.g. a single row of tabs)
+	const double count = static_cast<double>(std::min<size_t>(m_clickableRectangles.size(), MAX_GRID_CELLS));
+	const double aspect = static_cast<double>(m_gridBounds.width()) / m_gridBounds.height();
+	const int columns = std::clamp(static_cast<int>(std::lround(std::sqrt(count*aspect))), 1,
+		std::min(m_gridBounds.width(), MAX_GRID_CELLS));
+	const int rows = std::clamp(static_cast<int>(std::ceil(count/columns)), 1,
+		std::min(m_gridBounds.height(), MAX_GRID_CELLS/columns));
+	m_gridColumns = columns;
+	m_gridCellSize = QSize((m_gridBounds.width()+columns-1)/columns, (m_gridBounds.height()+rows-1)/rows);
+	m_gridCells.resize(static_cast<size_t>(columns*rows));
+
+	for (size_t index=0; index<m_clickableRectangles.size(); ++index)
+	{
+		const QRect rect = m_clickableRectangles[index].rect.normalized();
+		if (rect.isEmpty())
+		{
+			continue; // Never contains any point
+		}
+		const int left = (rect.left()-m_gridBounds.left())/m_gridCellSize.width();
+		const int right = (rect.right()-m_gridBounds.left())/m_gridCellSize.width();
+		const int top = (rect.top()-m_gridBounds.top())/m_gridCellSize.height();
+		const int bottom = (rect.bottom()-m_gridBounds.top())/m_gridCellSize.height();
+		for (int row=top; row<=bottom; ++row)
+		{
+			for (int column=left; column<=right; ++column)
+			{
+				m_gridCells[static_cast<size_t>(row*columns+column)].push_back(index);
+			}
+		}
+	}
+}
+
+//*////////////////////////////////////////////////////////////////////////////////////////////////
+const std::vector<size_t>& QClickManager::rectanglesNear( const QPoint& p)
+{
+	static const std::vector<size_t> none;
+	updateGrid();
+	if (!m_gridBounds.contains(p))
+	{
+		return none;
+	}
+	const int column = (p.x()-m_gridBounds.left())/m_gridCellSize.width();
+	const int row = (p.y()-m_gridBounds.top())/m_gridCellSize.height();
+	return m_gridCells[static_cast<size_t>(row*m_gridColumns+column)];
 }
 
 //*////////////////////////////////////////////////////////////////////////////////////////////////
@@ -321,12 +548,12 @@ void QClickManager::filterRectanglesContainingTheClick(const QPoint& cursorPos)
 		size_t id = *idIt;
 		
 		bool keepIt = true;
-		auto it = m_clickableRectangles.find(id);
-		if ( it == m_clickableRectangles.cend())
+		const auto* found = findRectangle(id);
+		if ( !found )
 		{
 			keepIt = false;
 		}
-		else if ( !it->second.contains( cursorPos ))
+		else if ( !found->rect.contains( cursorPos ))
 		{
 			keepIt = false;
 		}
@@ -19,10 +19,11 @@
 #ifndef QCLICKMANAGER_HPP
 #define QCLICKMANAGER_HPP
 
+#include <array>
 #include <cassert>
 #include <optional>
-#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <QWidget>
 #include <QEvent>
@@ -32,6 +33,44 @@
 namespace Escain
 {
 
+/**
+ * @brief Set of clickable rectangle ids, as provided by QClickManager signals
+ * 
+ * Usually one or two ids (overlapping areas): up to INLINE_CAPACITY ids are stored inline, so that
+ * filling, copying or passing it through a signal does not allocate. Order is not specified.
+ */
+class QClickIdSet
+{
+public:
+	using const_iterator = const size_t*;
+
+	bool empty() const { return m_size==0; }
+	size_t size() const { return m_size; }
+	const_iterator begin() const { return data(); }
+	const_iterator end() const { return data()+m_size; }
+	bool contains( size_t id) const;
+
+	/// Return false if already present
+	bool insert( size_t id);
+	/// Return false if not present
+	bool erase( size_t id);
+	/// Remove the id at it, return the iterator to the next id to visit (same position)
+	const_iterator erase( const_iterator it);
+	/// Remove all ids, keeping the allocated capacity
+	void clear();
+
+	static constexpr size_t INLINE_CAPACITY = 4;
+
+private:
+	const size_t* data() const { return m_spilled ? m_overflow.data() : m_inline.data(); }
+	size_t* data() { return m_spilled ? m_overflow.data() : m_inline.data(); }
+
+	std::array<size_t, INLINE_CAPACITY> m_inline{};
+	std::vector<size_t> m_overflow; // Only used beyond INLINE_CAPACITY
+	size_t m_size = 0;
+	bool m_spilled = false; // If the ids are in m_overflow
+};
+
 /**
  * @brief Utility to manage clicks: it reads press/unpress events on widget and generate clicks 
  * A click is defined as follow:
@@ -51,6 +90,11 @@ namespace Escain
  * In case of overlapping click areas, the click event is generated as soon as the click is 
  * valid for one of the areas: that is, at least one area match all conditions for a click (press,
  * release, threshold, etc).
+ * 
+ * Areas are indexed in a uniform grid, rebuilt lazily when they change: hover and press only
+ * check the areas of the grid cell under the cursor, whatever the number of areas.
+ * Areas are kept in a vector sorted by id, and the ids sets are QClickIdSet: mouse events do not
+ * allocate memory.
  */
 class QClickManager: public QObject
 {
@@ -89,24 +133,61 @@ public:
 	void enableHover(const QWidget& wid);
 	void disableHover();
 	bool isHoverEnabled() const;
+
+	/// When batched, hover changes are notified by a single hoverChanged signal per mouse event,
+	/// instead of one hovered signal per rectangle. Disabled by default.
+	bool batchedHover() const;
+	bool batchedHover( bool batch );
 	
 protected:
-	/// internal representation of the clickable areas
-	std::unordered_map<size_t, QRect> m_clickableRectangles;
+	struct ClickableRectangle
+	{
+		size_t id;
+		QRect rect;
+	};
+	/// internal representation of the clickable areas, sorted by id
+	/// Call invalidateGrid() after any change
+	std::vector<ClickableRectangle> m_clickableRectangles;
+	/// The area with that id, nullptr if not registered. O(log n)
+	const ClickableRectangle* findRectangle( size_t id) const;
+	/// Spatial index of m_clickableRectangles: indexes of the areas intersecting each cell
+	std::vector<std::vector<size_t>> m_gridCells;
+	QRect m_gridBounds; // Bounding rect of all areas
+	QSize m_gridCellSize;
+	int m_gridColumns = 0;
+	bool m_gridDirty = true;
+	/// Mark the spatial index to be rebuilt on next use
+	void invalidateGrid();
+	/// Rebuild the spatial index if invalidated
+	void updateGrid();
+	/// Indexes in m_clickableRectangles of the areas which may contain the point (those of it grid
+	/// cell), the caller must still check the rectangle. Valid until the next change of the areas.
+	const std::vector<size_t>& rectanglesNear( const QPoint& p);
+	/// Maximum number of cells, to keep the index memory bounded
+	static constexpr int MAX_GRID_CELLS = 16384;
+
 	/// Mouse initial press position, for threshold comparison
 	QPoint m_mousePressPosition;
 	/// Threshold displacement of the cursor while clicking, in manhattan distance
 	int m_clickThreshold = 10;
 	/// List of clickable areas ids candidates for the click event. (between the press and release event)
-	std::unordered_set<size_t> m_candidateRectanglesForClick;
+	QClickIdSet m_candidateRectanglesForClick;
 	/// List of ongoing hovered rectangles
-	std::unordered_set<size_t> m_hoveredRectangles;
+	QClickIdSet m_hoveredRectangles;
 	bool m_hoveredNoRectangles = false; // when no rectangles are set, use widget full rectangle
 	/// Remove from _candidateRectanglesForClick those areas which are not animore candidates for a click event.
 	void filterRectanglesContainingTheClick(const QPoint& cursorPos);
 	/// Update the list of hovered rectangles and eventually emit when relevant
 	///    isLeave allows to force hover-out
 	void manageHover( const QPoint& localCursorPos, bool isLeave=false );
+	/// Emit hovered, or record the change for hoverChanged if batched
+	void notifyHover( const QPoint& cursorPos, bool hover, size_t id, const QRect& rect );
+	/// If batched and anything changed, emit hoverChanged and reset the recorded changes
+	void flushHover( const QPoint& cursorPos );
+	bool m_batchedHover = false;
+	QClickIdSet m_hoverEntered; // Changes recorded for hoverChanged
+	QClickIdSet m_hoverLeft;
+	QRect m_hoverChangedRect;
 	/// If a click is in progress
 	bool m_clickInProgress = false;
 	/// Manage if the QClickManager is enabled or disabled. When disabled it does not emit
@@ -117,16 +198,21 @@ protected:
 signals: 
 	/// Signal for an effective click
 	/// the cursor pos is the latest position, the clickableRectangleIds is the list of candidates areas
-	void clicked(const QPoint& cursorPos, const std::unordered_set<size_t>& clickableRectangleIds);
+	void clicked(const QPoint& cursorPos, const QClickIdSet& clickableRectangleIds);
 	
 	/// Signals wether the mouse press an area: on button down, it call the signal with pressed=true
 	/// while when any action that cancel the click, or that triggers the click, it release the pressed state.
 	/// pressed signal is rised before clicked.
-	void pressed(const QPoint& cursorPos, bool pressed, const std::unordered_set<size_t>& clickableRectangleIds);
+	void pressed(const QPoint& cursorPos, bool pressed, const QClickIdSet& clickableRectangleIds);
 
 	/// Trigers when a clickableRectangle get or lose hover
 	/// It is called for each change on each rectangle.
 	void hovered(const QPoint& cursorPos, bool hovered, const size_t hoveredRectangleId, const QRect& rect);
+
+	/// With batchedHover, triggers once per mouse event when any rectangle get or lose hover,
+	/// with the ids which got the hover, those which lost it, and the union of their rectangles.
+	void hoverChanged(const QPoint& cursorPos, const QClickIdSet& enteredIds, const QClickIdSet& leftIds,
+		const QRect& changedRect);
 };
 
 
@@ -0,0 +1,146 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+
+
+#include "QFocusChain.hpp"
+
+#include <algorithm>
+
+namespace Escain
+{
+
+void QFocusChain::insert( size_t pos, QWidget* widget)
+{
+	prune();
+	pos = std::min(pos, m_widgets.size());
+	m_widgets.emplace(m_widgets.begin()+pos, widget);
+
+	if (!m_linking)
+	{
+		m_needsRelink = true;
+		return;
+	}
+
+	if (pos>0)
+	{
+		// Qt moves the widget right after its predecessor, that is, before the next one
+		link(m_widgets[pos-1], widget);
+	}
+	else if (m_widgets.size()>1)
+	{
+		// New first: what precedes the chain in Qt's focus chain is unknown (and may not accept
+		//     focus). Place it after the former first, then move the former first after it.
+		link(m_widgets[1], widget);
+		link(widget, m_widgets[1]);
+	}
+}
+
+bool QFocusChain::remove( QWidget* widget)
+{
+	prune();
+	const auto it = std::find(m_widgets.begin(), m_widgets.end(), widget);
+	if (!widget || it==m_widgets.end())
+	{
+		return false;
+	}
+
+	const size_t pos = static_cast<size_t>(std::distance(m_widgets.begin(), it));
+	m_widgets.erase(it);
+
+	if (!m_linking)
+	{
+		m_needsRelink = true;
+	}
+	else if (pos>0 && pos<m_widgets.size())
+	{
+		link(m_widgets[pos-1], m_widgets[pos]);
+	}
+	return true;
+}
+
+void QFocusChain::assign( const std::vector<QWidget*>& widgets)
+{
+	m_widgets.assign(widgets.begin(), widgets.end());
+	if (m_linking)
+	{
+		relink();
+	}
+	else
+	{
+		m_needsRelink = true;
+	}
+}
+
+void QFocusChain::relink()
+{
+	prune();
+	for (size_t i=1; i<m_widgets.size(); ++i)
+	{
+		link(m_widgets[i-1], m_widgets[i]);
+	}
+	m_needsRelink = false;
+}
+
+size_t QFocusChain::size() const
+{
+	return m_widgets.size();
+}
+
+QWidget* QFocusChain::at( size_t pos) const
+{
+	return pos<m_widgets.size() ? m_widgets[pos].data() : nullptr;
+}
+
+bool QFocusChain::linking() const
+{
+	return m_linking;
+}
+
+void QFocusChain::linking( bool enable)
+{
+	m_linking = enable;
+	if (m_linking && m_needsRelink)
+	{
+		relink();
+	}
+}
+
+size_t QFocusChain::tabOrderCalls() const
+{
+	return m_tabOrderCalls;
+}
+
+void QFocusChain::resetCounters()
+{
+	m_tabOrderCalls = 0;
+}
+
+void QFocusChain::prune()
+{
+	auto isDestroyed = [](const QPointer<QWidget>& w){ return w.isNull(); };
+	m_widgets.erase(std::remove_if(m_widgets.begin(), m_widgets.end(), isDestroyed), m_widgets.end());
+}
+
+void QFocusChain::link( QWidget* first, QWidget* second)
+{
+	QWidget::setTabOrder(first, second);
+	++m_tabOrderCalls;
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+
+
+#ifndef QFOCUSCHAIN_HPP
+#define QFOCUSCHAIN_HPP
+
+#include <vector>
+
+#include <QPointer>
+#include <QWidget>
+
+namespace Escain
+{
+
+/**
+ * @brief QFocusChain
+ *
+ * Ordered list of widgets, kept in that order in Qt's focus chain (TAB/shift+TAB order).
+ *
+ * Calling QWidget::setTabOrder for every pair of consecutive widgets after each change is O(n)
+ * for a single insertion. The chain remembers the order, so that an insertion or removal only
+ * links the neighbours of the changed widget: one setTabOrder call per edit (two for a new first).
+ *
+ * Widgets destroyed meanwhile are dropped from the chain (Qt already removed them from its focus
+ * chain). Linking can be suspended to apply many changes at once, see linking.
+ */
+class QFocusChain
+{
+public:
+	/// Insert the widget at pos (clamped to size) and link it to its neighbours
+	void insert( size_t pos, QWidget* widget);
+	/// Remove the widget from the chain and link together its neighbours
+	/// @return false if the widget is not in the chain
+	bool remove( QWidget* widget);
+	/// Replace the whole content, linked with size()-1 setTabOrder calls
+	void assign( const std::vector<QWidget*>& widgets);
+	/// Link again all consecutive widgets
+	void relink();
+
+	/// Number of widgets in the chain
+	size_t size() const;
+	/// Widget at the given position, nullptr if out of range or destroyed
+	QWidget* at( size_t pos) const;
+
+	/// While linking is disabled, changes are recorded without calling setTabOrder. Enabling it
+	///     again relinks the whole chain once, if anything changed meanwhile. Default: enabled.
+	bool linking() const;
+	void linking( bool enable);
+
+	/// Number of setTabOrder calls done by this chain
+	size_t tabOrderCalls() const;
+	/// Reset the setTabOrder calls counter
+	void resetCounters();
+
+private:
+	/// Drop the widgets destroyed since the last change
+	void prune();
+	void link( QWidget* first, QWidget* second);
+
+	std::vector<QPointer<QWidget>> m_widgets;
+	bool m_linking = true;
+	bool m_needsRelink = false; // Changed while linking was disabled
+	size_t m_tabOrderCalls = 0;
+};
+
+}
+
+#endif //QFOCUSCHAIN_HPP
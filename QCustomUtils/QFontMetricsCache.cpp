@@ -0,0 +1,201 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+
+#include "QFontMetricsCache.hpp"
+
+#include <cmath>
+#include <functional>
+
+#include <QGuiApplication>
+#include <QScreen>
+
+namespace Escain
+{
+
+namespace
+{
+	/// DPI used by QFontMetricsF built without paint device
+	qreal currentDpi()
+	{
+		const auto* screen = QGuiApplication::primaryScreen();
+		return screen ? screen->logicalDotsPerInch() : 96.0;
+	}
+}
+
+size_t QFontMetricsCache::Hasher::operator()( const Key& k) const
+{
+	return static_cast<size_t>(qHash(k.font)) ^ (std::hash<qreal>()(k.dpi) << 1);
+}
+
+size_t QFontMetricsCache::StringHasher::operator()( const QString& s) const
+{
+	return static_cast<size_t>(qHash(s));
+}
+
+size_t QFontMetricsCache::ElideHasher::operator()( const ElideKey& k) const
+{
+	size_t hash = static_cast<size_t>(qHash(k.text));
+	hash ^= static_cast<size_t>(k.width) + 0x9e3779b97f4a7c15ull + (hash<<6) + (hash>>2);
+	hash ^= static_cast<size_t>(k.mode) + 0x9e3779b97f4a7c15ull + (hash<<6) + (hash>>2);
+	return hash;
+}
+
+QFontMetricsCache::QFontMetricsCache()
+{
+	if (!qGuiApp)
+	{
+		return;
+	}
+
+	// Metrics depend on the application font (default QFont) and on the DPI
+	QObject::connect(qGuiApp, &QGuiApplication::fontChanged, qGuiApp, [this]()
+	{
+		invalidate();
+	});
+
+	auto watchScreen = [this](QScreen* screen)
+	{
+		QObject::connect(screen, &QScreen::logicalDotsPerInchChanged, qGuiApp, [this]()
+		{
+			invalidate();
+		});
+	};
+	for (auto* screen: QGuiApplication::screens())
+	{
+		watchScreen(screen);
+	}
+	QObject::connect(qGuiApp, &QGuiApplication::screenAdded, qGuiApp, watchScreen);
+	QObject::connect(qGuiApp, &QGuiApplication::primaryScreenChanged, qGuiApp, [this]()
+	{
+		invalidate();
+	});
+}
+
+QFontMetricsCache& QFontMetricsCache::instance()
+{
+	static QFontMetricsCache cache;
+	return cache;
+}
+
+QFontMetricsCache::Entry& QFontMetricsCache::entry( const QFont& font)
+{
+	Key key{font.key(), currentDpi()};
+	auto it = m_entries.find(key);
+	if (it == m_entries.end())
+	{
+		it = m_entries.emplace(std::move(key), Entry(font)).first;
+	}
+	return it->second;
+}
+
+const QFontMetricsF& QFontMetricsCache::metrics( const QFont& font)
+{
+	return entry(font).metrics;
+}
+
+qreal QFontMetricsCache::horizontalAdvance( const QFont& font, const QString& text)
+{
+	auto& fontEntry = entry(font);
+	const auto it = fontEntry.advances.find(text);
+	if (it != fontEntry.advances.end())
+	{
+		++m_hits;
+		return it->second;
+	}
+
+	++m_misses;
+	if (fontEntry.advances.size() >= MAX_STRINGS_PER_FONT)
+	{
+		fontEntry.advances.clear();
+	}
+	const qreal advance = fontEntry.metrics.horizontalAdvance(text);
+	fontEntry.advances.emplace(text, advance);
+	return advance;
+}
+
+qreal QFontMetricsCache::height( const QFont& font)
+{
+	return entry(font).metrics.height();
+}
+
+QString QFontMetricsCache::elidedText( const QFont& font, const QString& text, Qt::TextElideMode mode,
+	qreal width)
+{
+	// Elide to the bucket width, so that the result does not depend on the position in the bucket
+	const int bucket = static_cast<int>(std::floor(width));
+
+	auto& fontEntry = entry(font);
+	ElideKey key{text, bucket, mode};
+	const auto it = fontEntry.elided.find(key);
+	if (it != fontEntry.elided.end())
+	{
+		++m_elisionHits;
+		return it->second;
+	}
+
+	++m_elisionMisses;
+	if (fontEntry.elided.size() >= MAX_ELISIONS_PER_FONT)
+	{
+		fontEntry.elided.clear();
+	}
+	QString elided = fontEntry.metrics.elidedText(text, mode, bucket);
+	fontEntry.elided.emplace(std::move(key), elided);
+	return elided;
+}
+
+void QFontMetricsCache::invalidate()
+{
+	m_entries.clear();
+	++m_generation;
+}
+
+size_t QFontMetricsCache::generation() const
+{
+	return m_generation;
+}
+
+size_t QFontMetricsCache::hits() const
+{
+	return m_hits;
+}
+
+size_t QFontMetricsCache::misses() const
+{
+	return m_misses;
+}
+
+size_t QFontMetricsCache::elisionHits() const
+{
+	return m_elisionHits;
+}
+
+size_t QFontMetricsCache::elisionMisses() const
+{
+	return m_elisionMisses;
+}
+
+void QFontMetricsCache::resetCounters()
+{
+	m_hits = 0;
+	m_misses = 0;
+	m_elisionHits = 0;
+	m_elisionMisses = 0;
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+
+#ifndef QFONTMETRICSCACHE_HPP
+#define QFONTMETRICSCACHE_HPP
+
+#include <unordered_map>
+
+#include <QFont>
+#include <QFontMetricsF>
+#include <QString>
+
+namespace Escain
+{
+
+/**
+ * @brief QFontMetricsCache
+ *
+ * Process-wide text measurement service, shared by all custom widgets.
+ *
+ * Building a QFontMetrics is costly (font resolution and engine lookup), while widgets measure the
+ * same few labels with the same few fonts on every layout. The cache owns a single QFontMetricsF
+ * per font description and screen DPI, and memoizes the width of each measured string.
+ *
+ * Everything is forgotten on application font or screen DPI changes. References returned by
+ * metrics() must not be kept beyond the current call.
+ *
+ * Note: fonts can only be measured from the GUI thread, so is this cache.
+ */
+class QFontMetricsCache
+{
+public:
+	QFontMetricsCache( const QFontMetricsCache&) = delete;
+	QFontMetricsCache& operator=( const QFontMetricsCache&) = delete;
+
+	/// The cache shared by the whole process
+	static QFontMetricsCache& instance();
+
+	/// Metrics of the font for the current screen DPI, created once per font and DPI
+	const QFontMetricsF& metrics( const QFont& font);
+	/// Width of the text, memoized per font and string. See QFontMetricsF::horizontalAdvance
+	qreal horizontalAdvance( const QFont& font, const QString& text);
+	/// Line height of the font. See QFontMetricsF::height
+	qreal height( const QFont& font);
+	/// Text elided to fit in width, memoized per font, text, mode and width bucket (1px).
+	///     See QFontMetricsF::elidedText
+	QString elidedText( const QFont& font, const QString& text, Qt::TextElideMode mode, qreal width);
+
+	/// Forget all metrics and measures. Called automatically on application font and DPI changes
+	void invalidate();
+	/// Incremented by each invalidate: caches derived from measures keep it to detect outdated values
+	size_t generation() const;
+
+	/// Number of measures served from the cache
+	size_t hits() const;
+	/// Number of measures which required QFontMetricsF
+	size_t misses() const;
+	/// Number of elisions served from the cache
+	size_t elisionHits() const;
+	/// Number of elisions which required QFontMetricsF
+	size_t elisionMisses() const;
+	/// Reset the hits and misses counters
+	void resetCounters();
+
+private:
+	QFontMetricsCache();
+
+	struct Key
+	{
+		QString font; // QFont::key()
+		qreal dpi=0.0;
+		bool operator==( const Key& c) const { return c.dpi==dpi && c.font==font; }
+	};
+	struct Hasher
+	{
+		size_t operator()( const Key& k) const;
+	};
+	struct StringHasher
+	{
+		size_t operator()( const QString& s) const;
+	};
+	struct ElideKey
+	{
+		QString text;
+		int width=0; // Bucket of the available width
+		Qt::TextElideMode mode=Qt::ElideMiddle;
+		bool operator==( const ElideKey& c) const { return c.width==width && c.mode==mode && c.text==text; }
+	};
+	struct ElideHasher
+	{
+		size_t operator()( const ElideKey& k) const;
+	};
+	struct Entry
+	{
+		explicit Entry( const QFont& font) : metrics(font) {}
+		QFontMetricsF metrics;
+		std::unordered_map<QString, qreal, StringHasher> advances;
+		std::unordered_map<ElideKey, QString, ElideHasher> elided;
+	};
+
+	/// Metrics and measures for the font, created if needed
+	Entry& entry( const QFont& font);
+
+	std::unordered_map<Key, Entry, Hasher> m_entries;
+	size_t m_hits=0;
+	size_t m_misses=0;
+	size_t m_elisionHits=0;
+	size_t m_elisionMisses=0;
+	size_t m_generation=0;
+
+	static constexpr size_t MAX_STRINGS_PER_FONT = 4096; // Bound the memory of arbitrary labels
+	static constexpr size_t MAX_ELISIONS_PER_FONT = 4096; // Labels times widths seen while resizing
+};
+
+}
+
+#endif //QFONTMETRICSCACHE_HPP
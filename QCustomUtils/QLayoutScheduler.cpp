@@ -0,0 +1,143 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+#include "QLayoutScheduler.hpp"
+
+#include <cassert>
+
+#include <QCoreApplication>
+
+namespace Escain
+{
+
+QLayoutScheduler::QLayoutScheduler( QWidget& owner, const std::function<bool()>& pass,
+	const std::function<bool()>& forward)
+	: m_owner(owner)
+	, m_pass(pass)
+	, m_forward(forward)
+{
+}
+
+void QLayoutScheduler::schedule()
+{
+	if (m_inLayout)
+	{
+		return;
+	}
+	m_pending = true;
+
+	if (m_posted)
+	{
+		return;
+	}
+
+	if (m_updateDepth>0)
+	{
+		m_deferred = true;
+		return;
+	}
+
+	if (m_forward && m_forward())
+	{
+		return;
+	}
+
+	// High priority: processed before the (low priority) UpdateRequest, so paint sees the final geometry
+	m_posted = true;
+	QCoreApplication::postEvent(&m_owner, new QEvent(QEvent::LayoutRequest), Qt::HighEventPriority);
+}
+
+bool QLayoutScheduler::event( QEvent* e)
+{
+	if (e->type() == QEvent::LayoutRequest && m_posted) // Not posted by a child's updateGeometry
+	{
+		m_posted = false;
+		if (m_forward && m_forward())
+		{
+			return true; // Owned since posted: the owner's pass does it
+		}
+		if (m_pending) // Otherwise, already done by ensure
+		{
+			m_pending = false;
+			m_pass();
+		}
+		return true;
+	}
+	if (e->type() == QEvent::Polish)
+	{
+		m_pending = false;
+		m_pass(); // Before being shown for the first time
+	}
+	return false;
+}
+
+bool QLayoutScheduler::ensure()
+{
+	// Painting: geometry changes would only be shown in the next paint, after the posted request
+	if (!m_pending || m_inLayout || m_owner.paintingActive())
+	{
+		return false;
+	}
+	m_pending = false;
+	return m_pass();
+}
+
+bool QLayoutScheduler::inLayout() const
+{
+	return m_inLayout;
+}
+
+void QLayoutScheduler::inLayout( bool running)
+{
+	m_inLayout = running;
+	if (running)
+	{
+		m_pending = false; // Also when run by the owner's pass
+	}
+}
+
+bool QLayoutScheduler::beginUpdate()
+{
+	return m_updateDepth++ == 0;
+}
+
+bool QLayoutScheduler::endUpdate()
+{
+	if (m_updateDepth==0)
+	{
+		assert(false); // Unbalanced with beginUpdate
+		return false;
+	}
+	return --m_updateDepth == 0;
+}
+
+void QLayoutScheduler::flush()
+{
+	if (m_deferred)
+	{
+		m_deferred = false;
+		schedule();
+	}
+}
+
+bool QLayoutScheduler::updating() const
+{
+	return m_updateDepth>0;
+}
+
+}
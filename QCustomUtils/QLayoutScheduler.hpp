@@ -0,0 +1,103 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+
+
+#ifndef QLAYOUTSCHEDULER_HPP
+#define QLAYOUTSCHEDULER_HPP
+
+#include <functional>
+
+#include <QEvent>
+#include <QWidget>
+
+namespace Escain
+{
+
+/**
+ * @brief QLayoutScheduler
+ *
+ * Coalesce the layout requests of a widget into a single pass, run before painting.
+ *
+ * Property changes only mark what needs a layout and call schedule(): the first request posts a
+ * high priority LayoutRequest to the widget (processed before the low priority UpdateRequest, so
+ * paint sees the final geometry), the next ones are merged into it. The widget forwards its
+ * event() to this class, which runs the pass when the request is delivered, and on Polish.
+ *
+ * A widget laid out by its owner (e.g. a grid in a menu) forwards the request instead of posting
+ * it: the owner's pass lays out its children first.
+ *
+ * Getters of cached geometry (sizeHint...) call ensure(), so that a synchronous caller gets the
+ * current value even before the posted request is processed.
+ *
+ * Requests are only recorded during a transaction (see beginUpdate), and while the pass runs (it
+ * handles them itself).
+ */
+class QLayoutScheduler
+{
+public:
+	/// @param owner: the laid out widget, to which the LayoutRequest is posted
+	/// @param pass: the layout pass of owner, return if anything was laid out
+	/// @param forward: if set, called instead of posting the request. Return false if there is
+	///     nobody to forward it to (then, it is posted)
+	QLayoutScheduler( QWidget& owner, const std::function<bool()>& pass,
+		const std::function<bool()>& forward = std::function<bool()>());
+
+	QLayoutScheduler( const QLayoutScheduler&) = delete;
+	QLayoutScheduler& operator=( const QLayoutScheduler&) = delete;
+
+	/// Request a pass, merged with the already pending one
+	void schedule();
+
+	/// Handle the LayoutRequest posted by schedule, and Polish (laid out before being shown for the
+	///     first time). Return true if the event is consumed.
+	bool event( QEvent* e);
+
+	/// Run now the pending pass, if any: not while it runs, nor while the owner is painting.
+	/// @return true if anything was laid out
+	bool ensure();
+
+	/// Mark the pass as running (set by the pass of the owner): requests are ignored meanwhile
+	bool inLayout() const;
+	void inLayout( bool running);
+
+	/// Transactions can be nested: requests are only recorded until the outermost endUpdate
+	/// @return true when the outermost transaction starts: the caller then starts it own children
+	///     transactions
+	bool beginUpdate();
+	/// @return true when the outermost transaction ends: the caller then ends it own children
+	///     transactions and calls flush
+	bool endUpdate();
+	/// Schedule the pass requested during the transaction, if any
+	void flush();
+	bool updating() const;
+
+private:
+	QWidget& m_owner;
+	std::function<bool()> m_pass;
+	std::function<bool()> m_forward;
+	bool m_pending = false; // Requested since the last pass
+	bool m_posted = false; // A LayoutRequest is posted to the owner
+	bool m_inLayout = false;
+	size_t m_updateDepth = 0; // Nesting of beginUpdate
+	bool m_deferred = false; // Requested meanwhile m_updateDepth>0
+};
+
+}
+
+#endif // QLAYOUTSCHEDULER_HPP
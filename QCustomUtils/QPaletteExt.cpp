@@ -18,4 +18,112 @@
 
 #include "QPaletteExt.hpp"
 
+#include <map>
+#include <unordered_map>
+
+using namespace Escain;
+
+const QPaletteExt::ResolvedTable& QPaletteExt::table() const
+{
+	const qint64 key = cacheKey();
+	if (!m_table || m_tableKey != key)
+	{
+		m_table = resolve(*this);
+		m_tableKey = key;
+	}
+	return *m_table;
+}
+
+std::shared_ptr<const QPaletteExt::ResolvedTable> QPaletteExt::resolve( const QPalette& p)
+{
+	// Registry of resolved palettes, by QPalette::cacheKey. Palettes are a GUI-thread business, as
+	// the widgets painting with them, so no locking is done.
+	static std::unordered_map<qint64, std::shared_ptr<const ResolvedTable>> s_tables;
+	// Generation by resolved colors: copies of a palette which are detached without changing
+	// any color (or a palette set back to previous colors) keep the same generation.
+	using ColorsKey = std::array<quint64, std::tuple_size<decltype(ResolvedTable::colors)>::value>;
+	static std::map<ColorsKey, quint64> s_generations;
+	static quint64 s_lastGeneration=0;
+
+	const qint64 key = p.cacheKey();
+	const auto it = s_tables.find(key);
+	if (it != s_tables.end())
+	{
+		return it->second;
+	}
+
+	auto table = std::make_shared<ResolvedTable>();
+	ColorsKey colorsKey;
+	for (size_t group=0; group<QPalette::NColorGroups; ++group)
+	{
+		for (size_t roleIdx=0; roleIdx<ResolvedTable::ROLE_COUNT; ++roleIdx)
+		{
+			const size_t idx = group*ResolvedTable::ROLE_COUNT + roleIdx;
+			table->colors[idx] = computeColor(p, static_cast<QPalette::ColorGroup>(group),
+				static_cast<ColorRoleExt>(roleIdx+1));
+			colorsKey[idx] = table->colors[idx].rgba64();
+		}
+	}
+	table->isDarkTheme = computeIsDarkTheme(p);
+
+	if (s_generations.size() > 256)
+	{
+		s_generations.clear(); // Forgotten colors will simply take a new generation
+	}
+	auto& generation = s_generations[colorsKey];
+	if (generation == 0)
+	{
+		generation = ++s_lastGeneration;
+	}
+	table->generation = generation;
+
+	// The palette changes rarely, while copies keep the same cacheKey: a small registry is enough
+	if (s_tables.size() >= 64)
+	{
+		s_tables.clear();
+	}
+	s_tables.emplace(key, table);
+	return table;
+}
+
+QColor QPaletteExt::computeColor( const QPalette& p, QPalette::ColorGroup g, ColorRoleExt role)
+{
+	switch (role)
+	{
+	case ColorRoleExt::Background_Normal: return p.color(g, QPalette::Button);
+	case ColorRoleExt::Background_Hover: return blendColor(p.color(g, QPalette::Button), p.color(g, QPalette::Highlight), 0.1);
+	case ColorRoleExt::Background_Pressed: return blendColor(p.color(g, QPalette::Button), p.color(g, QPalette::Highlight), 0.2);
+	case ColorRoleExt::BackgroundMid_Normal: return blendColor(p.color(g, QPalette::Mid), p.color(g, QPalette::Button), 0.6);
+
+	case ColorRoleExt::TextOverBackground_Normal: return p.color(g, QPalette::ButtonText);
+	case ColorRoleExt::TextOverBackground_Hover: return p.color(g, QPalette::ButtonText);
+	case ColorRoleExt::TextOverBackground_Pressed: return p.color(g, QPalette::Text);
+
+	case ColorRoleExt::LinesOverBackground_Normal: return p.color(g, QPalette::Mid);
+	case ColorRoleExt::LinesOverBackground_Hover: return p.color(g, QPalette::Mid);
+	case ColorRoleExt::LinesOverBackground_Pressed: return p.color(g, QPalette::Mid);
+
+	case ColorRoleExt::PlaceholderText_Normal: return p.color(g, QPalette::PlaceholderText);
+	case ColorRoleExt::PlaceholderText_Hover: return p.color(g, QPalette::PlaceholderText);
+	case ColorRoleExt::PlaceholderText_Pressed: return p.color(g, QPalette::PlaceholderText);
+
+	case ColorRoleExt::Highlight_Normal: return p.color(g, QPalette::Highlight);
+	case ColorRoleExt::Highlight_Hover: return p.color(g, QPalette::Highlight);
+	case ColorRoleExt::Highlight_Pressed: return p.color(g, QPalette::Highlight);
+	default:
+		throw std::runtime_error("Not yet implemented: " + std::to_string(static_cast<int>(role)));
+	}
+}
+
+bool QPaletteExt::computeIsDarkTheme( const QPalette& p)
+{
+	QColor bg = p.window().color();
+	QColor text = p.text().color();
+
+	qreal bgGrey = (bg.redF()+bg.greenF() + bg.blueF());
+	qreal textGrey = (text.redF()+text.greenF()+text.blueF());
+	if (bgGrey/m_darkSchemeThreshold > textGrey) return false;
+	return true;
+}
+
 
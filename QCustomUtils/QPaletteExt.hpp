@@ -19,6 +19,11 @@
 #ifndef QPALETTE_EXT_HPP
 #define QPALETTE_EXT_HPP
 
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
 #include <QPalette>
 
 namespace Escain
@@ -59,9 +64,25 @@ enum class ColorRoleExt
  * @brief Util to generate more colors for a given palette. 
  * DON'T SAVE the result: OS can change the palette at any moment, each drawing
  * must retrieve the palette, not get a saved one.
+ *
+ * The extended colors of all roles and groups are resolved once per palette (identified by
+ * QPalette::cacheKey) and shared by all QPaletteExt built from it: building a QPaletteExt in each
+ * paintEvent and calling color() is a lookup, not a computation.
  */
 class QPaletteExt: public QPalette
 {
+public:
+	/// Colors of every ColorRoleExt for every ColorGroup of a palette
+	struct ResolvedTable
+	{
+		static constexpr size_t ROLE_COUNT = static_cast<size_t>(ColorRoleExt::Highlight_Pressed);
+		std::array<QColor, ROLE_COUNT*QPalette::NColorGroups> colors;
+		bool isDarkTheme=false;
+		/// Increase each time a palette resolve to different colors than any previous one.
+		/// Palettes resolving to the same colors share the same generation.
+		quint64 generation=0;
+	};
+
 protected:
 	constexpr static qreal m_darkSchemeThreshold = 0.5;
 	bool m_isDarkTheme=false;
@@ -69,7 +90,7 @@ public:
 	
 	// Default constructor/destructor/..
 	QPaletteExt() = default;
-	QPaletteExt( const QPalette& p): QPalette(p) { m_isDarkTheme = isDarkTheme(); }
+	QPaletteExt( const QPalette& p): QPalette(p) { m_isDarkTheme = table().isDarkTheme; }
 	QPaletteExt( const QPaletteExt& ) = default;
 	~QPaletteExt() = default;
 	
@@ -86,43 +107,30 @@ public:
 	}
 	const QColor color(ColorRoleExt role) const
 	{
-		switch (role)
+		const size_t roleIdx = static_cast<size_t>(role)-1;
+		if (roleIdx >= ResolvedTable::ROLE_COUNT)
 		{
-		case ColorRoleExt::Background_Normal: return QPalette::color(QPalette::Button);
-		case ColorRoleExt::Background_Hover: return blendColor(QPalette::color(QPalette::Button), QPalette::color(QPalette::Highlight), 0.1);
-		case ColorRoleExt::Background_Pressed: return blendColor(QPalette::color(QPalette::Button), QPalette::color(QPalette::Highlight), 0.2);
-		case ColorRoleExt::BackgroundMid_Normal: return blendColor(QPalette::color(QPalette::Mid), QPalette::color(QPalette::Button), 0.6);
-
-		case ColorRoleExt::TextOverBackground_Normal: return QPalette::color(QPalette::ButtonText);
-		case ColorRoleExt::TextOverBackground_Hover: return QPalette::color(QPalette::ButtonText);
-		case ColorRoleExt::TextOverBackground_Pressed: return QPalette::color(QPalette::Text);
-
-		case ColorRoleExt::LinesOverBackground_Normal: return QPalette::color(QPalette::Mid);
-		case ColorRoleExt::LinesOverBackground_Hover: return QPalette::color(QPalette::Mid);
-		case ColorRoleExt::LinesOverBackground_Pressed: return QPalette::color(QPalette::Mid);
-
-		case ColorRoleExt::PlaceholderText_Normal: return QPalette::color(QPalette::PlaceholderText);
-		case ColorRoleExt::PlaceholderText_Hover: return QPalette::color(QPalette::PlaceholderText);
-		case ColorRoleExt::PlaceholderText_Pressed: return QPalette::color(QPalette::PlaceholderText);
-
-		case ColorRoleExt::Highlight_Normal: return QPalette::color(QPalette::Highlight);
-		case ColorRoleExt::Highlight_Hover: return QPalette::color(QPalette::Highlight);
-		case ColorRoleExt::Highlight_Pressed: return QPalette::color(QPalette::Highlight);
-		default:
 			throw std::runtime_error("Not yet implemented: " + std::to_string(static_cast<int>(role)));
 		}
+		size_t group = static_cast<size_t>(currentColorGroup());
+		if (group >= QPalette::NColorGroups)
+		{
+			group = QPalette::Active;
+		}
+		return table().colors[group*ResolvedTable::ROLE_COUNT + roleIdx];
+	}
+
+	/// @brief Generation of the resolved colors: caches can compare it to know if a color they
+	///    computed from this palette is still valid, instead of comparing the colors.
+	quint64 generation() const
+	{
+		return table().generation;
 	}
 	
 	/// @brief detect if the palette is corresponding to a dark theme (white text on dark background)
 	bool isDarkTheme() const
 	{
-		QColor bg = QPalette::window().color();
-		QColor text = QPalette::text().color();
-		
-		qreal bgGrey = (bg.redF()+bg.greenF() + bg.blueF());
-		qreal textGrey = (text.redF()+text.greenF()+text.blueF());
-		if (bgGrey/m_darkSchemeThreshold > textGrey) return false;
-		return true;
+		return table().isDarkTheme;
 	}
 
 	static QColor blendColor( const QColor& color1, const QColor& color2, qreal prop)
@@ -136,6 +144,19 @@ public:
 		return result;
 	}
 
+private:
+	/// Resolved colors for the current content of the palette
+	/// (resolved again if the palette was modified since)
+	const ResolvedTable& table() const;
+
+	/// Shared table of the given palette, from the process registry or resolved now
+	static std::shared_ptr<const ResolvedTable> resolve( const QPalette& p);
+	/// Compute one extended color from the base colors of the palette
+	static QColor computeColor( const QPalette& p, QPalette::ColorGroup group, ColorRoleExt role);
+	static bool computeIsDarkTheme( const QPalette& p);
+
+	mutable std::shared_ptr<const ResolvedTable> m_table;
+	mutable qint64 m_tableKey=0; // QPalette::cacheKey for which m_table was resolved
 };
 
 
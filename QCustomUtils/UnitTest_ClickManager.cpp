@@ -63,7 +63,7 @@ public:
 
 	public slots:
 	
-	void clicked(const QPointF& cursorPos, const std::unordered_set<size_t>& clickableRectangleIds)
+	void clicked(const QPointF& cursorPos, const Escain::QClickIdSet& clickableRectangleIds)
 	{
 		QString s;
 		for (size_t id: clickableRectangleIds)
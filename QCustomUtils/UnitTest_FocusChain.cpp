@@ -0,0 +1,156 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+// Check that QFocusChain keeps Qt's focus chain in order, counting the setTabOrder calls per edit:
+// a single insertion or removal must not depend on the number of widgets.
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QApplication>
+#include <QWidget>
+
+#include "QFocusChain.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+/// If Qt's focus chain, starting at the first widget, visits the chain widgets in the chain order
+bool isInQtOrder( const QFocusChain& chain)
+{
+	if (chain.size()==0)
+	{
+		return true;
+	}
+
+	std::vector<QWidget*> expected;
+	for (size_t i=0; i<chain.size(); ++i)
+	{
+		expected.push_back(chain.at(i));
+	}
+
+	std::vector<QWidget*> visited;
+	QWidget* w = chain.at(0);
+	do
+	{
+		if (std::find(expected.begin(), expected.end(), w) != expected.end())
+		{
+			visited.push_back(w);
+		}
+		w = w->nextInFocusChain();
+	} while (w && w!=chain.at(0));
+
+	return visited == expected;
+}
+
+QWidget* newWidget( QWidget& parent)
+{
+	auto* w = new QWidget(&parent);
+	w->setFocusPolicy(Qt::StrongFocus);
+	return w;
+}
+
+/// Calls done by the edit
+template<typename F>
+size_t callsFor( QFocusChain& chain, F edit)
+{
+	chain.resetCounters();
+	edit();
+	return chain.tabOrderCalls();
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+
+	for (const size_t count: {10u, 100u, 1000u})
+	{
+		const std::string n = " (" + std::to_string(count) + " widgets)";
+		QWidget window;
+		QFocusChain chain;
+
+		// Widgets are created in reverse order: Qt's default chain is the creation order
+		std::vector<QWidget*> widgets(count);
+		for (size_t i=count; i>0; --i)
+		{
+			widgets[i-1] = newWidget(window);
+		}
+
+		size_t calls = callsFor(chain, [&](){ chain.assign(widgets); });
+		check(calls == count-1, "assign: one call per pair" + n);
+		check(isInQtOrder(chain), "assign: order" + n);
+
+		calls = callsFor(chain, [&](){ chain.insert(count/2, newWidget(window)); });
+		check(calls <= 1, "insert in the middle: " + std::to_string(calls) + " call" + n);
+		check(isInQtOrder(chain), "insert in the middle: order" + n);
+
+		calls = callsFor(chain, [&](){ chain.insert(0, newWidget(window)); });
+		check(calls <= 2, "insert first: " + std::to_string(calls) + " calls" + n);
+		check(isInQtOrder(chain), "insert first: order" + n);
+
+		calls = callsFor(chain, [&](){ chain.insert(chain.size(), newWidget(window)); });
+		check(calls <= 1, "insert last: " + std::to_string(calls) + " call" + n);
+		check(isInQtOrder(chain), "insert last: order" + n);
+
+		QWidget* removed = chain.at(chain.size()/3);
+		calls = callsFor(chain, [&](){ chain.remove(removed); });
+		check(calls <= 1, "remove: " + std::to_string(calls) + " call" + n);
+		check(isInQtOrder(chain), "remove: order" + n);
+		delete removed;
+
+		// Destroyed widgets are dropped without any call
+		delete chain.at(chain.size()/4);
+		calls = callsFor(chain, [&](){ chain.insert(1, newWidget(window)); });
+		check(calls <= 1, "insert after a destroyed widget: " + std::to_string(calls) + " call" + n);
+		check(isInQtOrder(chain), "insert after a destroyed widget: order" + n);
+
+		// Suspended linking: edits are free, then relinked once
+		chain.linking(false);
+		calls = callsFor(chain, [&]()
+		{
+			for (size_t i=0; i<10; ++i)
+			{
+				chain.insert(i*3, newWidget(window));
+			}
+		});
+		check(calls == 0, "insert without linking: no call" + n);
+		calls = callsFor(chain, [&](){ chain.linking(true); });
+		check(calls == chain.size()-1, "linking again: one call per pair" + n);
+		check(isInQtOrder(chain), "linking again: order" + n);
+	}
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}
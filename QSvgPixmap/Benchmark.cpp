@@ -0,0 +1,137 @@
+// Copyright Adrian Maire, all right reserved
+
+// Micro-benchmark of the QSvgPixmap raster pipeline, per icon size:
+// - legacy: render to ARGB32, SourceIn color fill, conversion to QPixmap (previous pipeline)
+// - pipeline: QSvgPixmap::renderImage (premultiplied, fused tint) and QPixmap::fromImage
+// - tint: QSvgPixmap::tintMask of a cached mask, for each available instruction set
+//
+// Usage: Benchmark_QSvgPixmap [file.svg]   (default: save_bg.svg, relative to the executable)
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <QApplication>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QPainter>
+#include <QSvgRenderer>
+
+#include "QSvgPixmap.hpp"
+#include "QSvgRasterKernels.hpp"
+
+using namespace Escain;
+
+namespace
+{
+/// Average time in microseconds of fct, repeated during about 200ms
+double measureUs( const std::function<void()>& fct)
+{
+	using Clock = std::chrono::steady_clock;
+	fct(); // Warm up
+
+	size_t iterations = 0;
+	const auto start = Clock::now();
+	auto now = start;
+	while (now - start < std::chrono::milliseconds(200))
+	{
+		fct();
+		++iterations;
+		now = Clock::now();
+	}
+	return std::chrono::duration<double, std::micro>(now - start).count() / iterations;
+}
+
+QPixmap legacyRender( QSvgRenderer& renderer, const QSize& size, const QColor& color)
+{
+	QImage img(size, QImage::Format_ARGB32);
+	img.fill(QColor(0,0,0,0));
+	QPainter p(&img);
+	p.setRenderHint(QPainter::Antialiasing, true);
+	renderer.render(&p, QRectF(QPointF(0.0,0.0), size));
+	p.setCompositionMode(QPainter::CompositionMode_SourceIn);
+	p.fillRect(QRect(QPoint(0,0), size), color);
+	p.end();
+
+	QPixmap pixmap;
+	pixmap.convertFromImage(img);
+	return pixmap;
+}
+
+const char* isaName( QSvgRasterKernels::Isa isa)
+{
+	switch (isa)
+	{
+		case QSvgRasterKernels::Isa::AVX2: return "AVX2";
+		case QSvgRasterKernels::Isa::SSE2: return "SSE2";
+		default: return "Scalar";
+	}
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+
+	const QString path = argn > 1 ? QString::fromLocal8Bit(argv[1]) : QStringLiteral("save_bg.svg");
+	QFile file(QDir(QCoreApplication::applicationDirPath()).absoluteFilePath(path));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		std::cerr << "Cannot open " << path.toStdString() << std::endl;
+		return 1;
+	}
+	const QByteArray svg = file.readAll();
+	QSvgRenderer renderer(svg);
+	const QColor color(64, 128, 192, 230);
+
+	std::cout << "Best instruction set: " << isaName(QSvgRasterKernels::bestIsa()) << "\n\n";
+	std::cout << std::setw(6) << "size" << std::setw(14) << "legacy(us)" << std::setw(14) << "pipeline(us)"
+		<< std::setw(10) << "speedup";
+	const std::vector<QSvgRasterKernels::Isa> isas{QSvgRasterKernels::Isa::Scalar,
+		QSvgRasterKernels::Isa::SSE2, QSvgRasterKernels::Isa::AVX2};
+	for (const auto isa: isas)
+	{
+		std::cout << std::setw(14) << (std::string("tint ") + isaName(isa));
+	}
+	std::cout << std::endl;
+
+	for (const int side: {16, 24, 32, 48, 64, 128, 256})
+	{
+		const QSize size(side, side);
+		const double legacy = measureUs([&]()
+		{
+			legacyRender(renderer, size, color);
+		});
+		const double pipeline = measureUs([&]()
+		{
+			QPixmap::fromImage(QSvgPixmap::renderImage(renderer, size,
+				QSvgPixmap::Stretch::Resized, color));
+		});
+
+		std::cout << std::setw(6) << side << std::fixed << std::setprecision(2)
+			<< std::setw(14) << legacy << std::setw(14) << pipeline
+			<< std::setw(9) << legacy/pipeline << "x";
+
+		const QImage mask = QSvgPixmap::renderMask(renderer, size, QSvgPixmap::Stretch::Resized);
+		for (const auto isa: isas)
+		{
+			QSvgRasterKernels::isa(isa);
+			if (QSvgRasterKernels::isa() != isa)
+			{
+				std::cout << std::setw(14) << "-"; // Not supported by this CPU
+				continue;
+			}
+			std::cout << std::setw(14) << measureUs([&]()
+			{
+				QSvgPixmap::tintMask(mask, color);
+			});
+		}
+		QSvgRasterKernels::isa(QSvgRasterKernels::bestIsa());
+		std::cout << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+// Copyright Adrian Maire, all right reserved
+
+#include "QSvgAsyncRasterizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+
+#include <QCoreApplication>
+#include <QPixmap>
+#include <QPointer>
+#include <QRunnable>
+#include <QSvgRenderer>
+#include <QThread>
+
+#include "QSvgDiskCache.hpp"
+
+namespace Escain
+{
+
+namespace
+{
+class RasterJob: public QRunnable
+{
+public:
+	RasterJob( const std::function<void()>& job ): m_job(job) {}
+	void run() override { m_job(); }
+private:
+	std::function<void()> m_job;
+};
+}
+
+QSvgAsyncRasterizer& QSvgAsyncRasterizer::instance()
+{
+	static QPointer<QSvgAsyncRasterizer> rasterizer;
+	if (!rasterizer)
+	{
+		assert(QCoreApplication::instance());
+		rasterizer = new QSvgAsyncRasterizer(QCoreApplication::instance());
+	}
+	return *rasterizer;
+}
+
+QSvgAsyncRasterizer::QSvgAsyncRasterizer( QObject* parent )
+	: QObject(parent)
+{
+	// Keep one core for the GUI thread
+	m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()-1));
+}
+
+QSvgAsyncRasterizer::~QSvgAsyncRasterizer()
+{
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+void QSvgAsyncRasterizer::request( const QSvgRasterStore::Key& key, const QByteArray& svgData,
+	const std::function<void()>& onReady)
+{
+	enqueue(m_pending, key, onReady, [key, svgData]()
+	{
+		return render(key, svgData);
+	}, [this, key](const QImage& image)
+	{
+		QSvgRasterStore::instance().park(key, QPixmap::fromImage(image));
+		notify(m_pending, key);
+	});
+}
+
+void QSvgAsyncRasterizer::requestMask( const QSvgRasterStore::Key& key, const QByteArray& svgData,
+	const std::function<void()>& onReady)
+{
+	assert(!key.colorOverride.isValid());
+	enqueue(m_pendingMasks, key, onReady, [key, svgData]()
+	{
+		return renderMask(key, svgData);
+	}, [this, key](const QImage& mask)
+	{
+		QSvgRasterStore::instance().parkMask(key, mask);
+		notify(m_pendingMasks, key);
+	});
+}
+
+void QSvgAsyncRasterizer::enqueue( Pending& pending, const QSvgRasterStore::Key& key,
+	const std::function<void()>& onReady, const std::function<QImage()>& job,
+	const std::function<void(const QImage&)>& deliver)
+{
+	auto it = pending.find(key);
+	if (it != pending.end())
+	{
+		it->second.push_back(onReady);
+		return;
+	}
+	pending.emplace(key, std::vector<std::function<void()>>{onReady});
+
+	m_pool.start(new RasterJob([this, job, deliver]()
+	{
+		const QImage image = job();
+		// Queued: deliver in the GUI thread, dropped if this object is destroyed in the while
+		QMetaObject::invokeMethod(this, [deliver, image]()
+		{
+			deliver(image);
+		}, Qt::QueuedConnection);
+	}));
+}
+
+size_t QSvgAsyncRasterizer::pendingCount() const
+{
+	return m_pending.size() + m_pendingMasks.size();
+}
+
+void QSvgAsyncRasterizer::notify( Pending& pending, const QSvgRasterStore::Key& key)
+{
+	const auto it = pending.find(key);
+	if (it == pending.end())
+	{
+		return;
+	}
+	const auto callbacks = std::move(it->second);
+	pending.erase(it);
+
+	for (const auto& callback: callbacks)
+	{
+		if (callback)
+		{
+			callback();
+		}
+	}
+}
+
+QImage QSvgAsyncRasterizer::render( const QSvgRasterStore::Key& key, const QByteArray& svgData)
+{
+	auto& diskCache = QSvgDiskCache::instance();
+	QImage cached = diskCache.load(key);
+	if (!cached.isNull())
+	{
+		return cached;
+	}
+
+	QImage image = QSvgPixmap::renderImage(threadRenderer(key, svgData), key.size, key.stretch,
+		key.colorOverride, key.devicePixelRatio);
+	diskCache.save(key, image);
+	return image;
+}
+
+QImage QSvgAsyncRasterizer::renderMask( const QSvgRasterStore::Key& key, const QByteArray& svgData)
+{
+	// Not in the disk cache: it only keeps colored (ARGB) rasters, and a mask is tinted anyway
+	return QSvgPixmap::renderMask(threadRenderer(key, svgData), key.size, key.stretch,
+		key.devicePixelRatio);
+}
+
+QSvgRenderer& QSvgAsyncRasterizer::threadRenderer( const QSvgRasterStore::Key& key,
+	const QByteArray& svgData)
+{
+	// QSvgRenderer cannot be shared among threads: keep one per svg content in each worker
+	struct ThreadRenderer
+	{
+		QByteArray data; // Compared on lookup, as QSvgPixmap::sharedRenderer does
+		std::unique_ptr<QSvgRenderer> renderer;
+	};
+	thread_local std::unordered_multimap<quint64, ThreadRenderer> renderers;
+
+	const auto range = renderers.equal_range(key.contentHash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.data == svgData)
+		{
+			return *it->second.renderer;
+		}
+	}
+
+	if (renderers.size() >= 64) // Keep memory bounded, this is rarely reached
+	{
+		renderers.clear();
+	}
+	auto renderer = std::make_unique<QSvgRenderer>();
+	renderer->load(svgData);
+	const auto inserted = renderers.emplace(key.contentHash, ThreadRenderer{svgData, std::move(renderer)});
+	return *inserted->second.renderer;
+}
+
+}
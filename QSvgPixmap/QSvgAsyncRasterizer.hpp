@@ -0,0 +1,81 @@
+// Copyright Adrian Maire, all right reserved
+
+#ifndef QSVGASYNCRASTERIZER_HPP
+#define QSVGASYNCRASTERIZER_HPP
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <QByteArray>
+#include <QImage>
+#include <QObject>
+#include <QThreadPool>
+
+class QSvgRenderer;
+
+#include "QSvgRasterStore.hpp"
+
+namespace Escain
+{
+/**
+ * @brief QSvgAsyncRasterizer
+ *
+ * Render svg images in a pool of worker threads, so that the GUI thread does not stall when many
+ * (or complex) icons needs to be rasterized at once: first show of a tab, theme change...
+ *
+ * Workers only produce QImage, each thread using it own QSvgRenderer. The result is converted to
+ * QPixmap in the GUI thread, parked in the QSvgRasterStore, and then the callbacks are called.
+ *
+ * Several requests for the same key are merged into a single job.
+ *
+ * Note: request() must be called from the GUI thread, callbacks are called from the GUI thread.
+ */
+class QSvgAsyncRasterizer: public QObject
+{
+	Q_OBJECT
+public:
+	/// The rasterizer shared by the whole process, owned by the QCoreApplication
+	static QSvgAsyncRasterizer& instance();
+
+	~QSvgAsyncRasterizer() override;
+
+	/// Queue the rendering of the given svg, onReady is called once the raster is in the store.
+	void request( const QSvgRasterStore::Key& key, const QByteArray& svgData,
+		const std::function<void()>& onReady);
+
+	/// Queue the rendering of the coverage mask (see QSvgPixmap::renderMask) of the given svg,
+	///     onReady is called once the mask is in the store. key has no colorOverride.
+	void requestMask( const QSvgRasterStore::Key& key, const QByteArray& svgData,
+		const std::function<void()>& onReady);
+
+	/// Number of jobs queued or being rendered
+	size_t pendingCount() const;
+
+private:
+	explicit QSvgAsyncRasterizer( QObject* parent );
+
+	using Pending = std::unordered_map<QSvgRasterStore::Key, std::vector<std::function<void()>>,
+		QSvgRasterStore::Hasher>;
+
+	/// Queue job for key, unless already pending, and call deliver with it result in the GUI thread
+	void enqueue( Pending& pending, const QSvgRasterStore::Key& key,
+		const std::function<void()>& onReady, const std::function<QImage()>& job,
+		const std::function<void(const QImage&)>& deliver);
+	/// Call and remove the callbacks pending for key
+	static void notify( Pending& pending, const QSvgRasterStore::Key& key);
+
+	/// Render in the calling (worker) thread
+	static QImage render( const QSvgRasterStore::Key& key, const QByteArray& svgData);
+	static QImage renderMask( const QSvgRasterStore::Key& key, const QByteArray& svgData);
+	/// Renderer of the svg owned by the calling (worker) thread
+	static QSvgRenderer& threadRenderer( const QSvgRasterStore::Key& key, const QByteArray& svgData);
+
+	QThreadPool m_pool;
+	Pending m_pending;
+	Pending m_pendingMasks;
+};
+
+}
+
+#endif //QSVGASYNCRASTERIZER_HPP
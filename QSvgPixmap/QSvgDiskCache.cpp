@@ -0,0 +1,313 @@
+// Copyright Adrian Maire, all right reserved
+
+#include "QSvgDiskCache.hpp"
+
+#include <cstring>
+#include <type_traits>
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+namespace Escain
+{
+
+namespace
+{
+/// Header of each cache file, followed by height*bytesPerLine bytes of pixels.
+struct FileHeader
+{
+	quint32 magic;
+	quint32 version;
+	quint64 keyHash;
+	quint64 contentHash;
+	qint32 width;
+	qint32 height;
+	qint32 bytesPerLine;
+	qint32 format;
+	qint32 stretch;
+	quint32 color;
+	quint32 colorValid;
+	quint32 reserved;
+	double devicePixelRatio;
+	quint64 checksum; // Of the pixels
+};
+static_assert(std::is_trivially_copyable<FileHeader>::value, "FileHeader is written as raw bytes");
+static_assert(sizeof(FileHeader)%8 == 0, "Pixels must remain aligned after the header");
+
+constexpr quint32 MAGIC = 0x45535643; // "ESVC", also detect endianness mismatch
+
+FileHeader headerFor( const QSvgRasterStore::Key& key, quint64 keyHash)
+{
+	FileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = MAGIC;
+	header.version = QSvgDiskCache::FORMAT_VERSION;
+	header.keyHash = keyHash;
+	header.contentHash = key.contentHash;
+	header.width = key.pixelSize().width(); // In device pixels
+	header.height = key.pixelSize().height();
+	header.stretch = static_cast<qint32>(key.stretch);
+	header.colorValid = key.colorOverride.isValid() ? 1 : 0;
+	header.color = key.colorOverride.isValid() ? key.colorOverride.rgba() : 0;
+	header.devicePixelRatio = key.devicePixelRatio;
+	return header;
+}
+
+/// Check the header identify the same key (not only the same file name)
+bool sameKey( const FileHeader& a, const FileHeader& b)
+{
+	return a.magic==b.magic && a.version==b.version && a.keyHash==b.keyHash &&
+		a.contentHash==b.contentHash && a.width==b.width && a.height==b.height &&
+		a.stretch==b.stretch && a.color==b.color && a.colorValid==b.colorValid &&
+		a.devicePixelRatio==b.devicePixelRatio;
+}
+
+quint64 checksum( const uchar* data, qint64 size)
+{
+	return QSvgPixmap::hashContent(QByteArray::fromRawData(reinterpret_cast<const char*>(data),
+		static_cast<int>(size)));
+}
+}
+
+QSvgDiskCache& QSvgDiskCache::instance()
+{
+	static QSvgDiskCache cache;
+	return cache;
+}
+
+void QSvgDiskCache::directory( const QString& dir)
+{
+	QMutexLocker lock(&m_mutex);
+	m_baseDirectory = dir;
+	m_directory.clear();
+	m_totalBytes = -1;
+
+	if (dir.isEmpty())
+	{
+		return;
+	}
+
+	// Only prune inside the sub-directory owned by the cache: dir may be shared with other data
+	const QString versionDir = QStringLiteral("v%1").arg(FORMAT_VERSION);
+	QDir base(QDir(dir).filePath(QStringLiteral("qsvgcache")));
+	if (!base.mkpath(versionDir))
+	{
+		return; // Not writable: keep disabled
+	}
+
+	// Discard files from other format versions
+	const QRegularExpression versionPattern(QStringLiteral("^v[0-9]+$"));
+	for (const auto& entry: base.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+	{
+		if (entry != versionDir && versionPattern.match(entry).hasMatch())
+		{
+			QDir(base.filePath(entry)).removeRecursively();
+		}
+	}
+
+	m_directory = base.filePath(versionDir);
+}
+
+QString QSvgDiskCache::directory() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_baseDirectory;
+}
+
+bool QSvgDiskCache::enabled() const
+{
+	QMutexLocker lock(&m_mutex);
+	return !m_directory.isEmpty();
+}
+
+void QSvgDiskCache::maxBytes( qint64 bytes)
+{
+	QMutexLocker lock(&m_mutex);
+	m_maxBytes = bytes;
+	evict();
+}
+
+qint64 QSvgDiskCache::maxBytes() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_maxBytes;
+}
+
+quint64 QSvgDiskCache::keyHash( const QSvgRasterStore::Key& key)
+{
+	QByteArray bytes;
+	QDataStream stream(&bytes, QIODevice::WriteOnly);
+	stream.setByteOrder(QDataStream::LittleEndian);
+	stream << key.contentHash << key.size.width() << key.size.height()
+		<< static_cast<qint32>(key.stretch) << key.colorOverride.isValid()
+		<< (key.colorOverride.isValid() ? key.colorOverride.rgba() : 0u)
+		<< static_cast<double>(key.devicePixelRatio);
+	return QSvgPixmap::hashContent(bytes);
+}
+
+QString QSvgDiskCache::filePath( const QSvgRasterStore::Key& key) const
+{
+	QMutexLocker lock(&m_mutex);
+	if (m_directory.isEmpty())
+	{
+		return QString();
+	}
+	return QDir(m_directory).filePath(QString::number(keyHash(key), 16) + QStringLiteral(".raster"));
+}
+
+QImage QSvgDiskCache::load( const QSvgRasterStore::Key& key)
+{
+	const QString path = filePath(key);
+	if (path.isEmpty() || !QFile::exists(path))
+	{
+		return QImage();
+	}
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(FileHeader)))
+	{
+		return QImage();
+	}
+
+	const qint64 fileSize = file.size();
+	const uchar* data = file.map(0, fileSize);
+	if (!data)
+	{
+		return QImage();
+	}
+
+	FileHeader header;
+	std::memcpy(&header, data, sizeof(header));
+
+	const uchar* pixels = data + sizeof(FileHeader);
+	const qint64 pixelBytes = static_cast<qint64>(header.bytesPerLine)*header.height;
+	const auto format = static_cast<QImage::Format>(header.format);
+
+	const bool valid = sameKey(header, headerFor(key, keyHash(key))) &&
+		(format == QImage::Format_ARGB32 || format == QImage::Format_ARGB32_Premultiplied) &&
+		header.bytesPerLine >= header.width*4 &&
+		fileSize == static_cast<qint64>(sizeof(FileHeader)) + pixelBytes &&
+		header.checksum == checksum(pixels, pixelBytes);
+
+	if (!valid)
+	{
+		// Corrupted, truncated or colliding: it will be rendered and saved again
+		file.close();
+		QFile::remove(path);
+		return QImage();
+	}
+
+	// Copy the pixels: keeping the file mapped for the image lifetime would hold a descriptor per
+	// image (thousands for a large menu), and prevent removing the file on some platforms
+	QImage image = QImage(pixels, header.width, header.height, header.bytesPerLine, format).copy();
+	file.close(); // Unmap
+	image.setDevicePixelRatio(header.devicePixelRatio);
+	return image;
+}
+
+bool QSvgDiskCache::save( const QSvgRasterStore::Key& key, const QImage& image)
+{
+	const QString path = filePath(key);
+	if (path.isEmpty() || image.isNull() || image.depth() != 32)
+	{
+		return false;
+	}
+
+	FileHeader header = headerFor(key, keyHash(key));
+	header.width = image.width();
+	header.height = image.height();
+	header.bytesPerLine = image.bytesPerLine();
+	header.format = static_cast<qint32>(image.format());
+	const qint64 pixelBytes = static_cast<qint64>(image.bytesPerLine())*image.height();
+	header.checksum = checksum(image.constBits(), pixelBytes);
+
+	if (image.size() != key.pixelSize())
+	{
+		return false; // load() would reject it anyway
+	}
+
+	// Size of the file replaced by the commit (0 if none), not to be counted twice
+	const qint64 replacedBytes = QFileInfo(path).size();
+
+	// Write in a temporary file, renamed on commit: other processes never see a partial file
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(image.constBits()), pixelBytes);
+	if (!file.commit())
+	{
+		return false;
+	}
+
+	QMutexLocker lock(&m_mutex);
+	if (m_totalBytes >= 0)
+	{
+		m_totalBytes += static_cast<qint64>(sizeof(header)) + pixelBytes - replacedBytes;
+	}
+	evict();
+	return true;
+}
+
+void QSvgDiskCache::clear()
+{
+	QMutexLocker lock(&m_mutex);
+	if (m_directory.isEmpty())
+	{
+		return;
+	}
+	QDir dir(m_directory);
+	for (const auto& entry: dir.entryList({QStringLiteral("*.raster")}, QDir::Files))
+	{
+		dir.remove(entry);
+	}
+	m_totalBytes = 0;
+}
+
+void QSvgDiskCache::evict()
+{
+	if (m_directory.isEmpty())
+	{
+		return;
+	}
+
+	QDir dir(m_directory);
+	if (m_totalBytes < 0)
+	{
+		m_totalBytes = 0;
+		for (const auto& info: dir.entryInfoList({QStringLiteral("*.raster")}, QDir::Files))
+		{
+			m_totalBytes += info.size();
+		}
+	}
+
+	if (m_totalBytes <= m_maxBytes)
+	{
+		return;
+	}
+
+	// Remove oldest first, down to 90% of the cap so eviction does not happen on each save
+	const qint64 target = m_maxBytes - m_maxBytes/10;
+	const auto files = dir.entryInfoList({QStringLiteral("*.raster")}, QDir::Files,
+		QDir::Time | QDir::Reversed);
+	for (const auto& info: files)
+	{
+		if (m_totalBytes <= target)
+		{
+			break;
+		}
+		if (QFile::remove(info.absoluteFilePath()))
+		{
+			m_totalBytes -= info.size();
+		}
+	}
+}
+
+}
@@ -0,0 +1,85 @@
+// Copyright Adrian Maire, all right reserved
+
+#ifndef QSVGDISKCACHE_HPP
+#define QSVGDISKCACHE_HPP
+
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+#include "QSvgRasterStore.hpp"
+
+namespace Escain
+{
+/**
+ * @brief QSvgDiskCache
+ *
+ * Optional process-wide cache of rendered svg images, persisted in a directory among executions.
+ * Disabled until a directory is set.
+ *
+ * Each raster is saved in its own file: a fixed header (identifying the key, format and checksum)
+ * followed by the raw pixels. Loading maps the file, checks it and copies the pixels into the
+ * QImage, without parsing nor rendering the svg. The file is closed right away: no descriptor is
+ * held by loaded images.
+ *
+ * - Versioning: files are kept in <directory>/qsvgcache/v<FORMAT_VERSION>, the other versions
+ *   in <directory>/qsvgcache are removed when the directory is set. Nothing else is touched, so
+ *   the directory can be shared with other data.
+ * - Size cap: when the total size exceed maxBytes, the oldest files are removed.
+ * - Corruption: files with invalid header, size or checksum are removed and ignored.
+ *
+ * Note: this class is thread-safe, so it can be used by QSvgAsyncRasterizer workers.
+ */
+class QSvgDiskCache
+{
+public:
+	QSvgDiskCache( const QSvgDiskCache&) = delete;
+	QSvgDiskCache& operator=( const QSvgDiskCache&) = delete;
+
+	/// The disk cache shared by the whole process
+	static QSvgDiskCache& instance();
+
+	/// Directory where rasters are persisted (in a qsvgcache sub-directory). Empty (default) to
+	///     disable the disk cache.
+	void directory( const QString& dir);
+	QString directory() const;
+	bool enabled() const;
+
+	/// Maximum size in bytes of all files in the cache
+	void maxBytes( qint64 bytes);
+	qint64 maxBytes() const;
+
+	/// Return the raster for key, or a null QImage if not cached (or invalid)
+	QImage load( const QSvgRasterStore::Key& key);
+
+	/// Persist the raster for key. Return false if not saved (e.g. disabled or not writable)
+	bool save( const QSvgRasterStore::Key& key, const QImage& image);
+
+	/// Remove all the files of the cache
+	void clear();
+
+	/// Increase when the file format changes, so that old files are discarded
+	static constexpr quint32 FORMAT_VERSION = 1;
+
+private:
+	QSvgDiskCache() = default;
+
+	/// Stable (among executions) identifier of the key, used as file name
+	static quint64 keyHash( const QSvgRasterStore::Key& key);
+
+	/// File for key in the versioned directory, empty if disabled
+	QString filePath( const QSvgRasterStore::Key& key) const;
+
+	/// Remove oldest files until the cache fits in maxBytes. m_mutex must be locked.
+	void evict();
+
+	mutable QMutex m_mutex;
+	QString m_directory; // Versioned directory, empty if disabled
+	QString m_baseDirectory;
+	qint64 m_maxBytes = 32*1024*1024;
+	qint64 m_totalBytes = -1; // Size of all files, -1 if not yet computed
+};
+
+}
+
+#endif //QSVGDISKCACHE_HPP
@@ -2,7 +2,11 @@
 
 #include "QSvgIcon.hpp"
 
+#include <array>
+#include <utility>
+
 #include <QByteArray>
+#include <QPaintDevice>
 #include <QPen>
 #include <QPainter>
 #include <QPaletteExt.hpp>
@@ -87,19 +91,121 @@ void QSvgIcon::paint( QPainter& p, const QRect& r, const QPaletteExt& pal,
 		}
 	}
 
+	const qreal devicePixelRatio = p.device() ? p.device()->devicePixelRatioF() : 1.0;
+	if (paintFromAtlas(p, iconRect, pal, roleText, roleHighlight, id, devicePixelRatio))
+	{
+		return;
+	}
+
 	if (m_iconBackground.hasPixmap())
 	{
-		const QPixmap& pixmapBg = m_iconBackground.pixmapFor(roleText, pal, id);
+		const QPixmap& pixmapBg = m_iconBackground.pixmapFor(roleText, pal, id, true, devicePixelRatio);
 		p.drawPixmap(iconRect, pixmapBg);
 	}
 
 	if (m_iconForeground.hasPixmap())
 	{
-		const QPixmap& pixmapFg = m_iconForeground.pixmapFor(roleHighlight, pal, id);
+		const QPixmap& pixmapFg = m_iconForeground.pixmapFor(roleHighlight, pal, id, true, devicePixelRatio);
 		p.drawPixmap(iconRect, pixmapFg);
 	}
 }
 
+bool QSvgIcon::paintFromAtlas( QPainter& p, const QRect& iconRect, const QPaletteExt& pal,
+	ColorRoleExt roleText, ColorRoleExt roleHighlight, size_t id, qreal devicePixelRatio) const
+{
+	const bool hasBg = m_iconBackground.hasPixmap();
+	const bool hasFg = m_iconForeground.hasPixmap();
+	const auto fragmentBg = hasBg ?
+		m_iconBackground.fragmentFor(roleText, pal, id, devicePixelRatio) : nullptr;
+	const auto fragmentFg = hasFg ?
+		m_iconForeground.fragmentFor(roleHighlight, pal, id, devicePixelRatio) : nullptr;
+
+	if ((hasBg && !fragmentBg) || (hasFg && !fragmentFg) || (!fragmentBg && !fragmentFg))
+	{
+		return false;
+	}
+
+	// Layers of the same page are drawn in a single call
+	const auto& atlas = QSvgIconAtlas::instance();
+	std::array<QPainter::PixmapFragment, 2> fragments;
+	int count=0;
+	size_t page=0;
+	for (const auto& fragment: {fragmentBg, fragmentFg})
+	{
+		if (fragment)
+		{
+			if (count > 0 && fragment->page != page)
+			{
+				p.drawPixmapFragments(fragments.data(), count, atlas.page(page));
+				count = 0;
+			}
+			page = fragment->page;
+			const QRectF& source = fragment->source;
+			fragments[count++] = QPainter::PixmapFragment::create(QRectF(iconRect).center(), source,
+				iconRect.width()/source.width(), iconRect.height()/source.height());
+		}
+	}
+	p.drawPixmapFragments(fragments.data(), count, atlas.page(page));
+	return true;
+}
+
+void QSvgIcon::prewarm( const QPaletteExt& pal, size_t id, qreal devicePixelRatio) const
+{
+	if (!idExists(id) || m_iconBackground.size(id).isEmpty())
+	{
+		return;
+	}
+
+	// Same roles as paint() for normal, hover and pressed
+	static constexpr std::array<std::pair<ColorRoleExt,ColorRoleExt>, 3> roles =
+	{
+		std::make_pair(ColorRoleExt::TextOverBackground_Normal, ColorRoleExt::Highlight_Normal),
+		std::make_pair(ColorRoleExt::TextOverBackground_Hover, ColorRoleExt::Highlight_Hover),
+		std::make_pair(ColorRoleExt::TextOverBackground_Pressed, ColorRoleExt::Highlight_Pressed)
+	};
+
+	QPaletteExt groupPal = pal;
+	for (const auto group: {QPalette::Active, QPalette::Inactive, QPalette::Disabled})
+	{
+		groupPal.setCurrentColorGroup(group);
+		for (const auto& [roleText, roleHighlight]: roles)
+		{
+			// Packed as paint() does: pixmapFor would copy back the pixels of packed ones
+			if (m_iconBackground.hasPixmap())
+			{
+				m_iconBackground.fragmentFor(roleText, groupPal, id, devicePixelRatio);
+			}
+			if (m_iconForeground.hasPixmap())
+			{
+				m_iconForeground.fragmentFor(roleHighlight, groupPal, id, devicePixelRatio);
+			}
+		}
+	}
+}
+
+void QSvgIcon::refreshColors( const QPaletteExt& pal, size_t id) const
+{
+	m_iconBackground.refreshColors(pal, id);
+	m_iconForeground.refreshColors(pal, id);
+}
+
+void QSvgIcon::deferColorChanges( bool defer, size_t id)
+{
+	m_iconBackground.deferColorChanges(defer, id);
+	m_iconForeground.deferColorChanges(defer, id);
+}
+
+void QSvgIcon::pinned( bool pin, size_t id)
+{
+	m_iconBackground.pinned(pin, id);
+	m_iconForeground.pinned(pin, id);
+}
+
+bool QSvgIcon::pinned( size_t id) const
+{
+	return m_iconBackground.pinned(id);
+}
+
 void QSvgIcon::margin( const int newMargin )
 {
 	m_marginWidth = newMargin;
@@ -117,6 +223,25 @@ int QSvgIcon::margin() const
 	return m_marginWidth;
 }
 
+void QSvgIcon::asyncRendering( bool enable)
+{
+	m_asyncRendering = enable;
+	m_iconBackground.asyncRendering(enable);
+	m_iconForeground.asyncRendering(enable);
+}
+
+bool QSvgIcon::asyncRendering() const
+{
+	return m_asyncRendering;
+}
+
+void QSvgIcon::rasterReady( const std::function<void(size_t)>& callback)
+{
+	m_rasterReady = callback;
+	m_iconBackground.rasterReady(callback);
+	m_iconForeground.rasterReady(callback);
+}
+
 void QSvgIcon::resize( const QSize& size, size_t id)
 {
 	assert(size.isValid());
@@ -154,6 +279,8 @@ bool QSvgIcon::hasIcon() const
 void QSvgIcon::iconBackground(QSvgPixmapCache&& newPixmapCache)
 {
 	m_iconBackground = newPixmapCache;
+	m_iconBackground.asyncRendering(m_asyncRendering);
+	m_iconBackground.rasterReady(m_rasterReady);
 }
 
 const QSvgPixmapCache& QSvgIcon::iconBackground() const
@@ -164,6 +291,8 @@ const QSvgPixmapCache& QSvgIcon::iconBackground() const
 void QSvgIcon::iconForeground(QSvgPixmapCache&& newPixmapCache)
 {
 	m_iconForeground = newPixmapCache;
+	m_iconForeground.asyncRendering(m_asyncRendering);
+	m_iconForeground.rasterReady(m_rasterReady);
 }
 
 const QSvgPixmapCache& QSvgIcon::iconForeground() const
@@ -32,8 +32,27 @@ public:
 	virtual QSvgIcon& operator=( const QSvgIcon&) = default;
 	
 	/// Paint the icon with the given palette, rect and painter
+	/// Pixmaps are rendered for the device pixel ratio of the painter device.
 	void paint( QPainter& p, const QRect& r, const QPaletteExt& pal,
 		bool pressed, bool hovered, size_t id=0) const;
+
+	/// Render in advance the pixmaps used by paint() for the id: normal/hover/pressed for each of
+	/// the active, inactive and disabled groups of the palette, packed in the atlas as paint()
+	/// does. Does nothing if the id is not sized.
+	/// devicePixelRatio should be the one of the widget painting the icon.
+	void prewarm( const QPaletteExt& pal, size_t id=0, qreal devicePixelRatio=1.0) const;
+
+	/// Render again the pixmaps of the id already cached, whose color changed with the palette.
+	/// See QSvgPixmapCache::refreshColors
+	void refreshColors( const QPaletteExt& pal, size_t id=0) const;
+
+	/// Keep painting the previous colors of the id after a palette change, until refreshColors.
+	/// See QSvgPixmapCache::deferColorChanges
+	virtual void deferColorChanges( bool defer, size_t id=0);
+
+	/// Pinned ids are never evicted to respect the memory budget. See QSvgPixmapCache::pinned
+	virtual void pinned( bool pin, size_t id=0);
+	virtual bool pinned( size_t id=0) const;
 	
 	/// Resize the intended QSvgIcon. This has significant cost
 	virtual void resize( const QSize& size, size_t id=0);
@@ -60,10 +79,23 @@ public:
 	/// Access the margin around the image
 	void margin( const int newMargin);
 	int margin() const;
+
+	/// Render both layers in background, see QSvgPixmapCache::asyncRendering
+	/// This setting is kept when the background/foreground images are replaced.
+	void asyncRendering( bool enable);
+	bool asyncRendering() const;
+
+	/// Called with the id when a layer rendered in background is available, see QSvgPixmapCache
+	void rasterReady( const std::function<void(size_t)>& callback);
 protected:
 	/// Default icon, if not filled
 	static constexpr std::string_view noIconSvg();
 
+	/// Draw both layers from QSvgIconAtlas, in a single drawPixmapFragments call if they are in the
+	///     same page. Return false (nothing drawn) if a layer is not available in the atlas.
+	bool paintFromAtlas( QPainter& p, const QRect& iconRect, const QPaletteExt& pal,
+		ColorRoleExt roleText, ColorRoleExt roleHighlight, size_t id, qreal devicePixelRatio) const;
+
 	QSvgPixmapCache m_iconBackground;
 	QSvgPixmapCache m_iconForeground;
 	
@@ -71,6 +103,8 @@ protected:
 	LastSizePerIdType m_lastSizePerId = {{0ull, QSize()}};
 	
 	int m_marginWidth=0;
+	bool m_asyncRendering=false;
+	std::function<void(size_t)> m_rasterReady;
 };
 }
 #endif //QSVGICON_HPP
@@ -0,0 +1,222 @@
+// Copyright Adrian Maire, all right reserved
+
+#include "QSvgIconAtlas.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include <QPainter>
+
+namespace Escain
+{
+
+QSvgIconAtlas& QSvgIconAtlas::instance()
+{
+	static QSvgIconAtlas atlas;
+	return atlas;
+}
+
+int QSvgIconAtlas::pageSide( int sizeClass)
+{
+	// Around 16x16 icons per page, but not too small pages for tiny icons
+	return std::clamp(sizeClass*16, 256, 1024);
+}
+
+std::shared_ptr<const QSvgIconAtlas::Fragment> QSvgIconAtlas::fragmentFor(
+	const QSvgRasterStore::Key& key, const QPixmap& raster)
+{
+	auto existing = find(key);
+	if (existing)
+	{
+		return existing;
+	}
+
+	const QSize size = raster.size();
+	const int largestSide = std::max(size.width(), size.height());
+	if (raster.isNull() || size.isEmpty() || largestSide > MAX_SIZE_CLASS)
+	{
+		return nullptr;
+	}
+
+	int sizeClass = 8;
+	while (sizeClass < largestSide)
+	{
+		sizeClass *= 2;
+	}
+
+	Fragment allocated = allocate(sizeClass, size);
+	allocated.devicePixelRatio = raster.devicePixelRatio();
+	Page& page = m_pages[allocated.page];
+
+	QPainter p(&page.pixmap);
+	p.setCompositionMode(QPainter::CompositionMode_Source);
+	p.fillRect(allocated.slot, Qt::transparent); // Slot may be reused
+	p.drawPixmap(allocated.source, raster); // Pixel to pixel, whatever the ratio of the raster
+	p.end();
+
+	std::shared_ptr<const Fragment> fragment(new Fragment(allocated), [this](const Fragment* f)
+	{
+		release(*f);
+		delete f;
+	});
+	m_fragments[key] = fragment;
+
+	if (m_fragments.size() > m_pruneThreshold)
+	{
+		for (auto fIt = m_fragments.begin(); fIt != m_fragments.end(); /*increase in loop*/)
+		{
+			fIt = fIt->second.expired() ? m_fragments.erase(fIt) : std::next(fIt);
+		}
+		// Amortize the cost of pruning among next insertions
+		m_pruneThreshold = std::max<size_t>(64, m_fragments.size()*2);
+	}
+	return fragment;
+}
+
+std::shared_ptr<const QSvgIconAtlas::Fragment> QSvgIconAtlas::find( const QSvgRasterStore::Key& key) const
+{
+	const auto it = m_fragments.find(key);
+	return it != m_fragments.end() ? it->second.lock() : nullptr;
+}
+
+QSvgIconAtlas::Fragment QSvgIconAtlas::allocate( int sizeClass, const QSize& size)
+{
+	Fragment fragment;
+	size_t unusedPage = m_pages.size();
+	for (size_t i=0; i<m_pages.size(); ++i)
+	{
+		Page& page = m_pages[i];
+		if (page.pixmap.isNull())
+		{
+			unusedPage = std::min(unusedPage, i);
+		}
+		else if (page.sizeClass == sizeClass && allocateInPage(page, size, fragment.slot))
+		{
+			fragment.page = i;
+			fragment.source = QRect(fragment.slot.topLeft(), size);
+			++page.used;
+			return fragment;
+		}
+	}
+
+	// No space: new page
+	if (unusedPage == m_pages.size())
+	{
+		m_pages.emplace_back();
+	}
+	Page& page = m_pages[unusedPage];
+	const int side = pageSide(sizeClass);
+	page.pixmap = QPixmap(side, side);
+	page.pixmap.fill(Qt::transparent);
+	m_bytes += pageBytes(page.pixmap);
+	QSvgRasterStore::instance().updateHighWater();
+	page.sizeClass = sizeClass;
+	page.cursor = QPoint(0,0);
+	page.freeSlots.clear();
+	page.used = 0;
+
+	const bool fit = allocateInPage(page, size, fragment.slot);
+	assert(fit);
+	(void)fit;
+	fragment.page = unusedPage;
+	fragment.source = QRect(fragment.slot.topLeft(), size);
+	++page.used;
+	return fragment;
+}
+
+bool QSvgIconAtlas::allocateInPage( Page& page, const QSize& size, QRect& slot)
+{
+	// First fit among released slots, the remaining part is kept free
+	for (auto it = page.freeSlots.begin(); it != page.freeSlots.end(); ++it)
+	{
+		if (it->width() >= size.width())
+		{
+			const QRect freeSlot = *it;
+			page.freeSlots.erase(it);
+			slot = QRect(freeSlot.topLeft(), QSize(size.width(), page.sizeClass));
+			if (freeSlot.width() > size.width())
+			{
+				page.freeSlots.push_back(QRect(freeSlot.x()+size.width(), freeSlot.y(),
+					freeSlot.width()-size.width(), page.sizeClass));
+			}
+			return true;
+		}
+	}
+
+	// Append to the current shelf, or open a new one
+	const int side = page.pixmap.width();
+	if (page.cursor.x() + size.width() > side)
+	{
+		page.cursor = QPoint(0, page.cursor.y() + page.sizeClass);
+	}
+	if (page.cursor.y() + page.sizeClass > side)
+	{
+		return false;
+	}
+
+	slot = QRect(page.cursor, QSize(size.width(), page.sizeClass));
+	page.cursor.rx() += size.width();
+	return true;
+}
+
+void QSvgIconAtlas::release( const Fragment& fragment)
+{
+	assert(fragment.page < m_pages.size());
+	Page& page = m_pages[fragment.page];
+	assert(page.used > 0);
+	--page.used;
+
+	if (page.used == 0)
+	{
+		m_bytes -= pageBytes(page.pixmap);
+		page.pixmap = QPixmap(); // Free the memory, the page index will be reused
+		page.freeSlots.clear();
+	}
+	else
+	{
+		page.freeSlots.push_back(fragment.slot);
+	}
+}
+
+const QPixmap& QSvgIconAtlas::page( size_t index) const
+{
+	assert(index < m_pages.size());
+	return m_pages[index].pixmap;
+}
+
+size_t QSvgIconAtlas::pageCount() const
+{
+	return static_cast<size_t>(std::count_if(m_pages.begin(), m_pages.end(),
+		[](const Page& page){ return !page.pixmap.isNull(); }));
+}
+
+size_t QSvgIconAtlas::fragmentCount( size_t page) const
+{
+	return page < m_pages.size() ? m_pages[page].used : 0;
+}
+
+size_t QSvgIconAtlas::bytes() const
+{
+	return m_bytes;
+}
+
+size_t QSvgIconAtlas::pageBytes( const QPixmap& pixmap)
+{
+	return static_cast<size_t>(pixmap.width())*static_cast<size_t>(pixmap.height())*
+		static_cast<size_t>(pixmap.depth())/8;
+}
+
+size_t QSvgIconAtlas::fragmentCount() const
+{
+	size_t count=0;
+	for (const auto& p: m_fragments)
+	{
+		if (!p.second.expired())
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+}
@@ -0,0 +1,108 @@
+// Copyright Adrian Maire, all right reserved
+
+#ifndef QSVGICONATLAS_HPP
+#define QSVGICONATLAS_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <QPixmap>
+#include <QRect>
+
+#include "QSvgRasterStore.hpp"
+
+namespace Escain
+{
+/**
+ * @brief QSvgIconAtlas
+ *
+ * Process-wide atlas packing small rendered icons into a few large pixmaps (pages), so that
+ * drawing an icon is a sub-rect blit, and several layers can be drawn in a single
+ * QPainter::drawPixmapFragments call.
+ *
+ * Rasters are grouped by size class (next power of two of their largest side): each page only
+ * contains one size class, packed in shelves of that height. Freed fragments are reused by next
+ * allocations of the same class.
+ *
+ * Fragments are reference-counted: the space is released as soon as no QSvgPixmapCache uses it,
+ * and a page is freed with its last fragment.
+ * Rasters larger than MAX_SIZE_CLASS are not packed (fragmentFor returns nullptr).
+ *
+ * Note: QPixmap can only be used from the GUI thread, so is this atlas.
+ */
+class QSvgIconAtlas
+{
+public:
+	/// Location of a raster in the atlas
+	struct Fragment
+	{
+		size_t page=0;  // See page()
+		QRect source;   // Pixels of the raster in the page
+		QRect slot;     // Reserved space in the page (may be larger than source)
+		qreal devicePixelRatio=1.0; // Of the raster: source is in device pixels
+	};
+
+	QSvgIconAtlas( const QSvgIconAtlas&) = delete;
+	QSvgIconAtlas& operator=( const QSvgIconAtlas&) = delete;
+
+	/// The atlas shared by the whole process
+	static QSvgIconAtlas& instance();
+
+	/// Return the fragment for the key, packing raster into a page if not already there.
+	/// Return nullptr if the raster is too large or empty.
+	std::shared_ptr<const Fragment> fragmentFor( const QSvgRasterStore::Key& key, const QPixmap& raster);
+
+	/// Return the fragment for the key if alive, nullptr otherwise (never pack).
+	std::shared_ptr<const Fragment> find( const QSvgRasterStore::Key& key) const;
+
+	/// Pixmap of the given page, to draw fragments from
+	const QPixmap& page( size_t index) const;
+
+	/// Number of pages currently allocated
+	size_t pageCount() const;
+	/// Number of fragments currently alive. O(n)
+	size_t fragmentCount() const;
+	/// Number of fragments currently alive in the given page
+	size_t fragmentCount( size_t page) const;
+	/// Memory used by the allocated pages, in bytes
+	size_t bytes() const;
+
+	static constexpr int MAX_SIZE_CLASS = 256; // Larger rasters are drawn standalone
+
+private:
+	QSvgIconAtlas() = default;
+
+	struct Page
+	{
+		QPixmap pixmap;     // Null when the page is not in use
+		int sizeClass=0;    // Height of shelves
+		QPoint cursor;      // Next free position in the current shelf
+		std::vector<QRect> freeSlots; // Released slots, reused first
+		size_t used=0;      // Number of fragments in this page
+	};
+
+	/// Reserve a slot in a page of that class, creating a page if required
+	Fragment allocate( int sizeClass, const QSize& size);
+
+	/// Give back the slot of a fragment
+	void release( const Fragment& fragment);
+
+	/// Reserve a slot in that page if there is space
+	static bool allocateInPage( Page& page, const QSize& size, QRect& slot);
+
+	/// Side of pages for a size class
+	static int pageSide( int sizeClass);
+	/// Memory of a page pixmap, in bytes
+	static size_t pageBytes( const QPixmap& pixmap);
+
+	std::vector<Page> m_pages; // Indexes are stable, unused pages are reused
+	std::unordered_map<QSvgRasterStore::Key, std::weak_ptr<const Fragment>,
+		QSvgRasterStore::Hasher> m_fragments;
+	size_t m_pruneThreshold=64; // Size of m_fragments triggering the removal of expired entries
+	size_t m_bytes=0; // See bytes()
+};
+
+}
+
+#endif //QSVGICONATLAS_HPP
@@ -2,12 +2,19 @@
 #include "QSvgPixmap.hpp"
 
 
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
 #include <QBitmap>			// To replace the color by another
 #include <QCoreApplication>	// Get current path for relative paths
 #include <QDir>				// Manage relative paths for loading
+#include <QFile>			// Read the svg content
 #include <QImage>			// Required to render the svg
 #include <QPainter>			// Required to render the svg
 
+#include "QSvgRasterKernels.hpp"
+
 namespace Escain
 {
 
@@ -22,12 +29,15 @@ namespace Escain
 		const QColor& colorOverride
 	)
 		: QPixmap()
-		, m_renderer( std::make_shared<QSvgRenderer>())
 		, m_colorOverride(colorOverride)
 	{
 		m_stretch = policy;
-		QString file = QDir(QCoreApplication::applicationDirPath()).absoluteFilePath(filepath);
-		m_renderer->load(file);
+		QFile file(QDir(QCoreApplication::applicationDirPath()).absoluteFilePath(filepath));
+		if (file.open(QIODevice::ReadOnly))
+		{
+			m_svgData = file.readAll();
+		}
+		m_contentHash = hashContent(m_svgData);
 
 		resize(size);
 	}
@@ -38,6 +48,9 @@ namespace Escain
 		, m_renderer( c.m_renderer)
 		, m_stretch(policy)
 		, m_colorOverride(colorOverride)
+		, m_renderDevicePixelRatio(c.m_renderDevicePixelRatio)
+		, m_svgData(c.m_svgData)
+		, m_contentHash(c.m_contentHash)
 	{
 		resize(size);
 	}
@@ -50,11 +63,11 @@ namespace Escain
 		const QColor& colorOverride
 	)
 		: QPixmap()
-		, m_renderer( std::make_shared<QSvgRenderer>())
 		, m_colorOverride(colorOverride)
+		, m_svgData(data)
 	{
 		m_stretch = policy;
-		m_renderer->load(data);
+		m_contentHash = hashContent(data);
 		resize(size);
 	}
 	
@@ -63,25 +76,103 @@ namespace Escain
 		, m_renderer(std::move(c.m_renderer))
 		, m_stretch(c.m_stretch)
 		, m_colorOverride(c.m_colorOverride)
+		, m_renderDevicePixelRatio(c.m_renderDevicePixelRatio)
+		, m_svgData(c.m_svgData)
+		, m_contentHash(c.m_contentHash)
 	{
-		resize(c.size());
+		resize(c.logicalSize());
 	}
 
 	void QSvgPixmap::resize( const QSize& size)
 	{
-		if (!m_renderer || !m_renderer->isValid()) return;
+		if (size.isEmpty()) return; // Nothing to render, do not parse the svg for it
+
+		auto* svgRenderer = renderer();
+		if (!svgRenderer || !svgRenderer->isValid()) return;
+
+		QImage img = renderImage(*svgRenderer, size, m_stretch, m_colorOverride, m_renderDevicePixelRatio);
+		if (!img.isNull())
+		{
+			// Already premultiplied: the pixmap can take the image buffer without conversion
+			QPixmap::operator=(QPixmap::fromImage(std::move(img)));
+		}
+	}
+
+	QSize QSvgPixmap::logicalSize() const
+	{
+		if (isNull()) return size();
+		return pixelSize(size(), 1.0/devicePixelRatio());
+	}
+
+	QSize QSvgPixmap::pixelSize( const QSize& size, qreal devicePixelRatio)
+	{
+		return QSize(qRound(size.width()*devicePixelRatio), qRound(size.height()*devicePixelRatio));
+	}
+
+	QImage QSvgPixmap::renderImage( const QSize& size, Stretch stretch,
+		const QColor& colorOverride, qreal devicePixelRatio) const
+	{
+		auto* svgRenderer = renderer();
+		if (!svgRenderer) return QImage();
+		return renderImage(*svgRenderer, size, stretch, colorOverride, devicePixelRatio);
+	}
+
+	QImage QSvgPixmap::renderMask( const QSize& size, Stretch stretch, qreal devicePixelRatio) const
+	{
+		auto* svgRenderer = renderer();
+		if (!svgRenderer) return QImage();
+		return renderMask(*svgRenderer, size, stretch, devicePixelRatio);
+	}
+
+	QImage QSvgPixmap::renderMask( QSvgRenderer& renderer, const QSize& size, Stretch stretch,
+		qreal devicePixelRatio)
+	{
+		const QImage img = renderImage(renderer, size, stretch, QColor(), devicePixelRatio);
+		if (img.isNull()) return QImage();
+
+		QImage mask(img.size(), QImage::Format_Alpha8);
+		mask.setDevicePixelRatio(img.devicePixelRatio());
+		for (int y=0; y<img.height(); ++y)
+		{
+			QSvgRasterKernels::alphaFromArgb(reinterpret_cast<const quint32*>(img.constScanLine(y)),
+				mask.scanLine(y), static_cast<size_t>(img.width()));
+		}
+		return mask;
+	}
+
+	QImage QSvgPixmap::tintMask( const QImage& mask, const QColor& color)
+	{
+		if (mask.isNull()) return QImage();
+		assert(mask.format() == QImage::Format_Alpha8);
+
+		const quint32 premultipliedColor = QSvgRasterKernels::premultiply(color.rgba());
+		QImage tinted(mask.size(), QImage::Format_ARGB32_Premultiplied);
+		tinted.setDevicePixelRatio(mask.devicePixelRatio());
+		for (int y=0; y<mask.height(); ++y)
+		{
+			QSvgRasterKernels::tintAlpha(mask.constScanLine(y),
+				reinterpret_cast<quint32*>(tinted.scanLine(y)), static_cast<size_t>(mask.width()),
+				premultipliedColor);
+		}
+		return tinted;
+	}
+
+	QImage QSvgPixmap::renderImage( QSvgRenderer& renderer, const QSize& size, Stretch stretch,
+		const QColor& colorOverride, qreal devicePixelRatio)
+	{
+		if (!renderer.isValid()) return QImage();
 
 		// Calculate the image size based on Stretch
 		QSizeF imgSize = size;
-		QSizeF svgSize = m_renderer->defaultSize();
+		QSizeF svgSize = renderer.defaultSize();
 		QRectF renderRect(QPointF(0.0,0.0), imgSize);
-		if (m_stretch!=Stretch::Resized && !imgSize.isEmpty() && !svgSize.isEmpty())
+		if (stretch!=Stretch::Resized && !imgSize.isEmpty() && !svgSize.isEmpty())
 		{
 			double svgRatio = svgSize.width() / svgSize.height();
 			double imgRatio = imgSize.width() / imgSize.height();
 
-			if ((m_stretch==Stretch::Cover && svgRatio > imgRatio ) ||
-				(m_stretch==Stretch::Contain && svgRatio <= imgRatio))
+			if ((stretch==Stretch::Cover && svgRatio > imgRatio ) ||
+				(stretch==Stretch::Contain && svgRatio <= imgRatio))
 			{ // Adjust to Height
 				renderRect.setSize(QSizeF(imgSize.height()*svgRatio, imgSize.height()));
 				renderRect.moveTopLeft(QPointF((imgSize.width()-renderRect.width())*0.5,0.0));
@@ -93,32 +184,106 @@ namespace Escain
 			}
 		}
 
-		if (!renderRect.isEmpty() && !imgSize.isEmpty())
+		if (renderRect.isEmpty() || imgSize.isEmpty())
 		{
-			QImage img(imgSize.toSize(),QImage::Format_ARGB32);
-			img.fill(QColor(0,0,0,0));
-			QPainter p(&img);
-			p.setRenderHint(QPainter::Antialiasing, true);
-			
-			if (m_colorOverride.isValid())
+			return QImage();
+		}
+
+		// Premultiplied is the native format of QPainter and QPixmap: no conversion pass
+		// With the ratio set, the painter keeps working in device independent pixels
+		QImage img(pixelSize(imgSize.toSize(), devicePixelRatio), QImage::Format_ARGB32_Premultiplied);
+		img.setDevicePixelRatio(devicePixelRatio);
+		img.fill(Qt::transparent);
+		QPainter p(&img);
+		p.setRenderHint(QPainter::Antialiasing, true);
+		renderer.render(&p, renderRect);
+		p.end();
+
+		if (colorOverride.isValid())
+		{
+			// Replace the color keeping the coverage, in a single pass over the rendered pixels
+			const quint32 premultipliedColor = QSvgRasterKernels::premultiply(colorOverride.rgba());
+			for (int y=0; y<img.height(); ++y)
 			{
-				p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+				QSvgRasterKernels::tintArgb(reinterpret_cast<quint32*>(img.scanLine(y)),
+					static_cast<size_t>(img.width()), premultipliedColor);
+			}
+		}
+
+		return img;
+	}
 	
-				m_renderer->render(&p, renderRect);
-				p.setCompositionMode(QPainter::CompositionMode_SourceIn);
-				p.fillRect(renderRect, m_colorOverride);
+	quint64 QSvgPixmap::hashContent( const QByteArray& data )
+	{
+		// FNV-1a: std::hash does not guarantee the same value among executions
+		quint64 hash = 14695981039346656037ull;
+		for (const char c: data)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	QSvgRenderer* QSvgPixmap::renderer() const
+	{
+		if (!m_renderer && !m_svgData.isEmpty())
+		{
+			m_renderer = sharedRenderer(m_svgData, m_contentHash);
+		}
+		return m_renderer.get();
+	}
+
+	std::shared_ptr<QSvgRenderer> QSvgPixmap::sharedRenderer( const QByteArray& data,
+		quint64 contentHash)
+	{
+		// Parsed documents by content: only weak references, so unused documents are freed.
+		// QSvgRenderer is a QObject, this registry is used from the GUI thread only.
+		struct Interned
+		{
+			QByteArray data; // Compared on lookup, a hash collision must not share the document
+			std::weak_ptr<QSvgRenderer> renderer;
+		};
+		static std::unordered_multimap<quint64, Interned> s_renderers;
+		static size_t s_pruneThreshold = 64;
+
+		const auto range = s_renderers.equal_range(contentHash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.data == data)
+			{
+				auto renderer = it->second.renderer.lock();
+				if (renderer)
+				{
+					return renderer;
+				}
+				s_renderers.erase(it);
+				break;
 			}
-			else
+		}
+
+		auto renderer = std::make_shared<QSvgRenderer>();
+		if (!data.isEmpty())
+		{
+			renderer->load(data);
+		}
+		s_renderers.emplace(contentHash, Interned{data, renderer});
+
+		if (s_renderers.size() > s_pruneThreshold)
+		{
+			for (auto it = s_renderers.begin(); it != s_renderers.end(); /*increase in loop*/)
 			{
-				m_renderer->render(&p, renderRect);
+				it = it->second.renderer.expired() ? s_renderers.erase(it) : std::next(it);
 			}
-				
-			convertFromImage(img);
+			// Amortize the cost of pruning among next insertions
+			s_pruneThreshold = std::max<size_t>(64, s_renderers.size()*2);
 		}
+		return renderer;
 	}
-	
+
 	bool QSvgPixmap::hasImage() const
 	{
-		return (m_renderer && m_renderer->isValid() && !m_renderer->defaultSize().isNull());
+		const auto* svgRenderer = renderer();
+		return (svgRenderer && svgRenderer->isValid() && !svgRenderer->defaultSize().isNull());
 	}
 }
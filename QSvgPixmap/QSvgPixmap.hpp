@@ -23,6 +23,13 @@ namespace Escain
  * Convenience extended behavior for Pixmaps, allowing to load svg of specific size and
  * resize rendering.
  * ColorOverride allow to draw the full pixmap in a specific color (set it to QColor() to clear)
+ *
+ * The parsed svg (QSvgRenderer) is shared by all QSvgPixmap created from the same content, even
+ * when loaded separately (e.g. the same file in several places). It is freed with the last of them.
+ * The svg is only parsed when first needed: to render or to know if there is an image.
+ *
+ * For HiDPI screens, set renderDevicePixelRatio: the svg is rendered with size*ratio pixels and the
+ * pixmap devicePixelRatio is set, so that it is painted sharp at the logical size.
  */
 class QSvgPixmap: public QPixmap
 {
@@ -36,9 +43,12 @@ public:
 	};
 	
 private:
-	std::shared_ptr<QSvgRenderer> m_renderer; // pointer so that QSvgPixmap is movable
+	mutable std::shared_ptr<QSvgRenderer> m_renderer; // Shared by same content, parsed lazily
 	Stretch m_stretch;
 	QColor m_colorOverride;
+	qreal m_renderDevicePixelRatio=1.0;
+	QByteArray m_svgData; // Implicitly shared by copies, allows to render in other threads
+	quint64 m_contentHash=0; // Identify the svg content, shared by copies
 public:
 
 	// Constructor & Destructor
@@ -66,14 +76,58 @@ public:
 	/// this is different from QPixmap::isNull() which return false if size()==QSize().
 	virtual bool hasImage() const;
 	
+	/// Render at the given size, in device independent pixels
 	virtual void resize( const QSize& size);
+
+	/// Size in device independent pixels (QPixmap::size() is in device pixels)
+	QSize logicalSize() const;
 	
 	const QColor& colorOverride() const {return m_colorOverride; }
-	QColor& colorOverride( const QColor& c) { m_colorOverride = c; resize(size()); return m_colorOverride; }
+	QColor& colorOverride( const QColor& c) { m_colorOverride = c; resize(logicalSize()); return m_colorOverride; }
 	
 	const Stretch& stretch() const { return m_stretch; }
-	Stretch& stretch( const Stretch& c) { m_stretch = c; resize(size()); return m_stretch; }
+	Stretch& stretch( const Stretch& c) { m_stretch = c; resize(logicalSize()); return m_stretch; }
+
+	/// Device pixel ratio of the screen the pixmap is rendered for (1.0 by default)
+	qreal renderDevicePixelRatio() const { return m_renderDevicePixelRatio; }
+	qreal renderDevicePixelRatio( qreal r) { const QSize s = logicalSize(); m_renderDevicePixelRatio = r; resize(s); return r; }
+
+	/// Size in device pixels of an image of size (device independent pixels) for that ratio
+	static QSize pixelSize( const QSize& size, qreal devicePixelRatio);
+
+	/// Hash of the svg content, identical for any QSvgPixmap created from the same svg bytes
+	quint64 contentHash() const { return m_contentHash; }
+	/// Stable (among executions) hash of svg bytes
+	static quint64 hashContent( const QByteArray& data );
+
+	/// Svg content this pixmap was created from
+	const QByteArray& svgData() const { return m_svgData; }
+
+	/// Render the svg into a new image (Format_ARGB32_Premultiplied) with the given stretch and
+	/// colorOverride. Only uses QImage, thus it can be called from any thread (with a renderer owned
+	/// by that thread).
+	/// The image has pixelSize(size, devicePixelRatio) pixels, and that devicePixelRatio.
+	static QImage renderImage( QSvgRenderer& renderer, const QSize& size, Stretch stretch,
+		const QColor& colorOverride, qreal devicePixelRatio=1.0);
+	/// Same, with the renderer of this pixmap (GUI thread only)
+	QImage renderImage( const QSize& size, Stretch stretch, const QColor& colorOverride,
+		qreal devicePixelRatio=1.0) const;
+
+	/// Render the coverage of the svg (Format_Alpha8), to be colored with tintMask
+	static QImage renderMask( QSvgRenderer& renderer, const QSize& size, Stretch stretch,
+		qreal devicePixelRatio=1.0);
+	QImage renderMask( const QSize& size, Stretch stretch, qreal devicePixelRatio=1.0) const;
+
+	/// Color a coverage mask with color (Format_ARGB32_Premultiplied), without rendering the svg.
+	/// This is the colorOverride result, at the cost of a lookup per pixel.
+	static QImage tintMask( const QImage& mask, const QColor& color);
+
+private:
+	/// The renderer of the svg, parsing it on first call. nullptr if there is no svg content
+	QSvgRenderer* renderer() const;
 
+	/// Renderer parsed from data, shared with any alive QSvgPixmap having the same content
+	static std::shared_ptr<QSvgRenderer> sharedRenderer( const QByteArray& data, quint64 contentHash);
 };
 
 
@@ -2,32 +2,189 @@
 
 #include "QSvgPixmapCache.hpp"
 
+#include "QSvgAsyncRasterizer.hpp"
+#include "QSvgDiskCache.hpp"
+#include "QSvgIconAtlas.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <QFile>
+#include <QTimer>
 
 namespace Escain
 {
 
 std::shared_ptr<QPixmap> QSvgPixmapCache::m_default;
+quint64 QSvgPixmapCache::m_useClock = 0;
+bool QSvgPixmapCache::m_evictionScheduled = false;
+quint64 QSvgPixmapCache::m_lastEvictionUse = 0;
+
+QSvgPixmapCache::QSvgPixmapCache()
+{
+	declareId(0);
+	instances().insert(this);
+}
+
+QSvgPixmapCache::QSvgPixmapCache( const QSvgPixmapCache& c)
+	: m_colorOverride(c.m_colorOverride)
+	, m_asyncRendering(c.m_asyncRendering)
+	, m_rasterReady(c.m_rasterReady)
+	, m_pixmap(c.m_pixmap)
+	, m_pendingPath(c.m_pendingPath)
+	, m_loadError(c.m_loadError)
+	, m_policy(c.m_policy)
+{
+	copySets(c);
+	instances().insert(this);
+}
+
+QSvgPixmapCache& QSvgPixmapCache::operator=( const QSvgPixmapCache& c)
+{
+	if (this != &c)
+	{
+		m_colorOverride = c.m_colorOverride;
+		m_asyncRendering = c.m_asyncRendering;
+		m_rasterReady = c.m_rasterReady;
+		m_pixmap = c.m_pixmap;
+		m_pendingPath = c.m_pendingPath;
+		m_loadError = c.m_loadError;
+		m_policy = c.m_policy;
+		copySets(c);
+	}
+	return *this;
+}
+
+void QSvgPixmapCache::copySets( const QSvgPixmapCache& c)
+{
+	// Sharing sets among caches would share colorOverride changes, clone them instead
+	m_cache.clear();
+	m_sizedSets.clear();
+	std::unordered_map<const QSvgSizedCache*, std::shared_ptr<QSvgSizedCache>> clones;
+	for (const auto& [id, idCache]: c.m_cache)
+	{
+		auto& clone = clones[idCache.sized.get()];
+		if (!clone)
+		{
+			clone = std::make_shared<QSvgSizedCache>(*idCache.sized);
+			m_sizedSets[sizeKey(clone->size)] = clone;
+		}
+		m_cache.emplace(id, idCache).first->second.sized = clone;
+	}
+}
+
+quint64 QSvgPixmapCache::sizeKey( const QSize& size)
+{
+	return (static_cast<quint64>(static_cast<quint32>(size.width()))<<32ull) |
+		static_cast<quint32>(size.height());
+}
+
+std::shared_ptr<QSvgPixmapCache::QSvgSizedCache> QSvgPixmapCache::sizedSet( const QSize& size)
+{
+	auto& weakSet = m_sizedSets[sizeKey(size)];
+	auto set = weakSet.lock();
+	if (!set)
+	{
+		set = std::make_shared<QSvgSizedCache>();
+		set->size = size;
+		weakSet = set;
+	}
+	return set;
+}
+
+void QSvgPixmapCache::releaseSizedSet( const QSize& size)
+{
+	const auto it = m_sizedSets.find(sizeKey(size));
+	if (it != m_sizedSets.end() && it->second.expired())
+	{
+		m_sizedSets.erase(it);
+	}
+}
+
+QSvgPixmapCache::~QSvgPixmapCache()
+{
+	instances().erase(this);
+}
+
+std::unordered_set<QSvgPixmapCache*>& QSvgPixmapCache::instances()
+{
+	static auto* caches = new std::unordered_set<QSvgPixmapCache*>();
+	return *caches;
+}
 
 size_t QSvgPixmapCache::Hasher::operator()(const QSvgPixmapCacheKey& v) const
 {
-	return (static_cast<size_t>(v.role)&0xffffffffull) + 
-		((static_cast<size_t>(v.group)&0xffffffffull)<<32ull); 
+	return ((static_cast<size_t>(v.role)&0xffffffffull) + 
+		((static_cast<size_t>(v.group)&0xffffffffull)<<32ull)) ^ std::hash<qreal>()(v.devicePixelRatio); 
 }
 
-QSvgPixmapCache::QSvgPixmapCacheKey::QSvgPixmapCacheKey( const ColorRoleExt& r, const QPalette::ColorGroup& c)
+QSvgPixmapCache::QSvgPixmapCacheKey::QSvgPixmapCacheKey( const ColorRoleExt& r, const QPalette::ColorGroup& c,
+	qreal dpr)
 	: role(r)
 	, group(c)
+	, devicePixelRatio(dpr)
 {
 }
 
 bool QSvgPixmapCache::QSvgPixmapCacheKey::operator==( const QSvgPixmapCacheKey& c) const
 {
-	return c.role==role && c.group==group; 
+	return c.role==role && c.group==group && c.devicePixelRatio==devicePixelRatio; 
 }
 
 const QPixmap& QSvgPixmapCache::pixmapFor(const ColorRoleExt& role, 
-	const QPaletteExt& palette, size_t id, bool throwIfEmpty) const
+	const QPaletteExt& palette, size_t id, bool throwIfEmpty, qreal devicePixelRatio) const
+{
+	bool current = false;
+	auto* value = valueFor(role, palette, id, throwIfEmpty, devicePixelRatio, current);
+	if (value)
+	{
+		const auto& pixmap = valuePixmap(*value);
+		assert(!pixmap.isNull());
+		return pixmap;
+	}
+	if (hasPixmap())
+	{
+		return QSvgRasterStore::instance().placeholder(m_cache.at(id).sized->size);
+	}
+	if (!m_default)
+	{
+		m_default = std::make_shared<QPixmap>();
+	}
+	return *m_default;
+}
+
+std::shared_ptr<const QSvgIconAtlas::Fragment> QSvgPixmapCache::fragmentFor(const ColorRoleExt& role,
+	const QPaletteExt& palette, size_t id, qreal devicePixelRatio) const
+{
+	bool current = false;
+	auto* value = valueFor(role, palette, id, false, devicePixelRatio, current);
+	if (!value)
+	{
+		return nullptr;
+	}
+
+	// Only pack current values: the nearest one shown meanwhile may be of another ratio
+	if (!value->fragment && value->pixmap && current)
+	{
+		auto& sized = *m_cache.at(id).sized;
+		const QColor overrideColor = m_colorOverride ? value->color: QColor();
+		value->fragment = QSvgIconAtlas::instance().fragmentFor(
+			rasterKey(sized.size, overrideColor, devicePixelRatio), *value->pixmap);
+		if (value->fragment)
+		{
+			value->pixmap.reset(); // The atlas keeps the pixels, and serves next requests for them
+			if (QSvgRasterStore::instance().overBudget()) // The atlas may have grown a page
+			{
+				scheduleEviction();
+			}
+		}
+	}
+	return value->fragment;
+}
+
+QSvgPixmapCache::QSvgPixmapCacheValue* QSvgPixmapCache::valueFor(const ColorRoleExt& role,
+	const QPaletteExt& palette, size_t id, bool throwIfEmpty, qreal devicePixelRatio, bool& current) const
 {
 	const auto sizeIt = m_cache.find(id);
 	if ( sizeIt == m_cache.cend())
@@ -35,47 +192,505 @@ const QPixmap& QSvgPixmapCache::pixmapFor(const ColorRoleExt& role,
 		assert(false);
 		throw std::runtime_error("Accessing QSvgPixmapCache for unknown id. First declare it.");
 	}
-	
-	const auto color = palette.color(role);
-	const QSvgPixmapCacheKey key(role, palette.currentColorGroup());
-	auto& sizedCache = sizeIt->second.sizedCache;
-	const auto& size = sizeIt->second.size;
-	
+
+	const QSvgPixmapCacheKey key(role, palette.currentColorGroup(), devicePixelRatio);
+	auto& sized = *sizeIt->second.sized;
+	auto& sizedCache = sized.sizedCache;
 	const auto mapIt = sizedCache.find(key);
 
-	if (mapIt == sizedCache.cend() || (m_colorOverride && color != mapIt->second.color))
+	current = true;
+	if (mapIt != sizedCache.end() && isCurrent(mapIt->second, role, palette))
+	{
+		mapIt->second.lastUse = ++m_useClock;
+		return &mapIt->second;
+	}
+
+	if (!hasPixmap())
 	{
-		if (mapIt != sizedCache.cend())
+		if (mapIt != sizedCache.end())
 		{
 			sizedCache.erase(mapIt);
 		}
+		if (throwIfEmpty)
+		{
+			assert(false);
+			throw std::runtime_error("No file is loaded to generate pixmaps.");
+		}
+		return nullptr;
+	}
+
+	current = false;
+	if (mapIt != sizedCache.end() && sizeIt->second.colorsDeferred)
+	{
+		return &mapIt->second; // Previous colors, until refreshColors
+	}
+
+	QSvgPixmapCacheValue rendered;
+	if (!renderValue(sized, palette.color(role), palette.generation(), id, devicePixelRatio, rendered))
+	{
+		// Being rendered in background: meanwhile, use the nearest available pixmap
+		return mapIt != sizedCache.end() ? &mapIt->second : nearestValue(sized, key);
+	}
+
+	current = true;
+	auto& value = sizedCache.insert_or_assign(key, std::move(rendered)).first->second;
+	value.lastUse = ++m_useClock;
+	if (QSvgRasterStore::instance().overBudget())
+	{
+		scheduleEviction();
+	}
+	return &value;
+}
+
+bool QSvgPixmapCache::renderValue( QSvgSizedCache& sized, const QColor& color, quint64 generation,
+	size_t id, qreal devicePixelRatio, QSvgPixmapCacheValue& value) const
+{
+	const QColor overrideColor = m_colorOverride ? color: QColor();
+
+	// Once packed, the standalone raster is released: the atlas serves it to all caches
+	const auto key = rasterKey(sized.size, overrideColor, devicePixelRatio);
+	auto fragment = QSvgIconAtlas::instance().find(key);
+	if (fragment)
+	{
+		QSvgRasterStore::instance().addHits(1);
+		value = QSvgPixmapCacheValue{color, nullptr, std::move(fragment), generation};
+		return true;
+	}
+
+	auto raster = m_asyncRendering ? asyncRaster(sized, overrideColor, id, devicePixelRatio) :
+		sharedRaster(sized, overrideColor, devicePixelRatio);
+	if (!raster)
+	{
+		return false;
+	}
+	value = QSvgPixmapCacheValue{color, std::move(raster), nullptr, generation};
+	return true;
+}
+
+void QSvgPixmapCache::refreshColors( const QPaletteExt& palette, size_t id) const
+{
+	const auto sizeIt = m_cache.find(id);
+	if (sizeIt == m_cache.end())
+	{
+		return;
+	}
+	sizeIt->second.colorsDeferred = false;
+	if (sizeIt->second.sized->sizedCache.empty() || !hasPixmap())
+	{
+		return; // Nothing rendered yet (do not load a deferred svg for it)
+	}
+
+	auto& sized = *sizeIt->second.sized;
+	QPaletteExt groupPal = palette;
+	for (auto& [key, value]: sized.sizedCache)
+	{
+		groupPal.setCurrentColorGroup(key.group);
+		if (isCurrent(value, key.role, groupPal))
+		{
+			continue;
+		}
+
+		// Otherwise, being rendered in background: keep the previous colors meanwhile
+		QSvgPixmapCacheValue rendered;
+		if (renderValue(sized, groupPal.color(key.role), groupPal.generation(), id, key.devicePixelRatio,
+			rendered))
+		{
+			rendered.lastUse = value.lastUse;
+			value = std::move(rendered);
+		}
+	}
+}
+
+void QSvgPixmapCache::deferColorChanges( bool defer, size_t id)
+{
+	const auto sizeIt = m_cache.find(id);
+	if (sizeIt != m_cache.end())
+	{
+		sizeIt->second.colorsDeferred = defer;
+	}
+}
+
+bool QSvgPixmapCache::colorChangesDeferred( size_t id) const
+{
+	const auto sizeIt = m_cache.find(id);
+	return sizeIt != m_cache.end() && sizeIt->second.colorsDeferred;
+}
+
+void QSvgPixmapCache::pinned( bool pin, size_t id)
+{
+	const auto sizeIt = m_cache.find(id);
+	if (sizeIt != m_cache.end() && sizeIt->second.pinned != pin)
+	{
+		sizeIt->second.pinned = pin;
+		if (pin)
+		{
+			++sizeIt->second.sized->pins;
+		}
+		else
+		{
+			--sizeIt->second.sized->pins;
+		}
+	}
+}
+
+bool QSvgPixmapCache::pinned( size_t id) const
+{
+	const auto sizeIt = m_cache.find(id);
+	return sizeIt != m_cache.end() && sizeIt->second.pinned;
+}
+
+void QSvgPixmapCache::scheduleEviction()
+{
+	if (!m_evictionScheduled)
+	{
+		m_evictionScheduled = true;
+		QTimer::singleShot(0, []()
+		{
+			m_evictionScheduled = false;
+			evictToBudget();
+		});
+	}
+}
+
+void QSvgPixmapCache::evictToBudget()
+{
+	auto& store = QSvgRasterStore::instance();
+	if (!store.overBudget())
+	{
+		return;
+	}
+
+	// Rendered in background but never shown (widget destroyed, color changed...): free them first
+	store.releaseParked();
+	const size_t usage = store.memoryUsage();
+	const size_t target = store.memoryBudget()/10*9;
+	if (usage <= target)
+	{
+		return;
+	}
+	const size_t needed = usage - target;
+
+	// Only values whose raster is not used elsewhere free memory: rasters shared with other caches
+	// live on with them. Packed values only free memory with the last fragment of their atlas page:
+	// they are evicted by whole page, if no fragment of it is used elsewhere (pinned, shared...).
+	struct Value
+	{
+		QSvgSizedCache* sized; // Kept alive by the ids using it during the eviction
+		QSvgPixmapCacheKey key;
+	};
+	struct PageValues
+	{
+		quint64 lastUse=0; // Most recent use of the values
+		std::vector<Value> values;
+	};
+	struct Candidate
+	{
+		quint64 lastUse;
+		Value value; // Not packed
+		const PageValues* page; // Packed: all the values of the page, nullptr if not packed
+		size_t bytes; // Freed by evicting it
+	};
+	const auto& atlas = QSvgIconAtlas::instance();
+	std::vector<Candidate> candidates;
+	std::unordered_map<size_t, PageValues> pages; // By atlas page index
+	for (auto* cache: instances())
+	{
+		for (const auto& [sizeId, weakSet]: cache->m_sizedSets)
+		{
+			auto sized = weakSet.lock();
+			if (!sized || sized->pins > 0)
+			{
+				continue;
+			}
+			for (const auto& [key, value]: sized->sizedCache)
+			{
+				if (value.pixmap && value.pixmap.use_count() == 1)
+				{
+					const auto& pixmap = *value.pixmap;
+					const size_t bytes = static_cast<size_t>(pixmap.width())*
+						static_cast<size_t>(pixmap.height())*static_cast<size_t>(pixmap.depth())/8;
+					candidates.push_back(Candidate{value.lastUse, Value{sized.get(), key}, nullptr,
+						bytes});
+				}
+				else if (!value.pixmap && value.fragment && value.fragment.use_count() == 1)
+				{
+					auto& page = pages[value.fragment->page];
+					page.lastUse = std::max(page.lastUse, value.lastUse);
+					page.values.push_back(Value{sized.get(), key});
+				}
+			}
+		}
+	}
+	for (const auto& [index, page]: pages)
+	{
+		if (page.values.size() == atlas.fragmentCount(index))
+		{
+			const auto& pixmap = atlas.page(index);
+			const size_t bytes = static_cast<size_t>(pixmap.width())*
+				static_cast<size_t>(pixmap.height())*static_cast<size_t>(pixmap.depth())/8;
+			candidates.push_back(Candidate{page.lastUse, Value{nullptr, {}}, &page, bytes});
+		}
+	}
+	size_t evictable = 0;
+	for (const auto& candidate: candidates)
+	{
+		evictable += candidate.bytes;
+	}
+
+	// If the budget can not be met anyway, evicting pixmaps used since the previous pass (likely
+	// on screen) would only render them again at next paint, and schedule another pass
+	const quint64 newestEvictable = evictable < needed ? m_lastEvictionUse :
+		std::numeric_limits<quint64>::max();
 
-		if (hasPixmap())
+	// Min-heap by last use: only the evicted candidates are ordered
+	auto usedLater = [](const Candidate& a, const Candidate& b)
+	{
+		return a.lastUse > b.lastUse;
+	};
+	std::make_heap(candidates.begin(), candidates.end(), usedLater);
+
+	size_t evicted=0;
+	auto evict = [&evicted](const Value& value)
+	{
+		auto& sized = *value.sized;
+		sized.sizedCache.erase(value.key);
+		if (sized.sizedCache.empty())
+		{
+			sized.mask.reset();
+		}
+		++evicted;
+	};
+
+	// Stop once enough is freed, or as soon as the usage is back under the target (e.g. the
+	// freed rasters were also the last reference of masks)
+	size_t freed=0;
+	for (auto end = candidates.end(); freed < needed && store.memoryUsage() > target &&
+		end != candidates.begin(); --end)
+	{
+		std::pop_heap(candidates.begin(), end, usedLater);
+		const auto& candidate = *std::prev(end);
+		if (candidate.lastUse > newestEvictable)
+		{
+			break; // All others were used later
+		}
+
+		if (candidate.page)
 		{
-			sizedCache.emplace(key, QSvgPixmapCacheValue{color, QSvgPixmap(m_pixmap, size,
-			    m_policy, m_colorOverride ? color: QColor() )});
+			for (const auto& value: candidate.page->values)
+			{
+				evict(value);
+			}
 		}
 		else
 		{
-			if (throwIfEmpty)
+			evict(candidate.value);
+		}
+		freed += candidate.bytes;
+	}
+	m_lastEvictionUse = m_useClock;
+	store.addEvictions(evicted);
+}
+
+bool QSvgPixmapCache::isCurrent( QSvgPixmapCacheValue& value, const ColorRoleExt& role,
+	const QPaletteExt& palette) const
+{
+	const quint64 generation = palette.generation();
+	if (!m_colorOverride || value.generation == generation)
+	{
+		return true;
+	}
+	if (value.color != palette.color(role))
+	{
+		return false;
+	}
+	value.generation = generation; // Palette changed, but not this color
+	return true;
+}
+
+const QPixmap& QSvgPixmapCache::valuePixmap( QSvgPixmapCacheValue& value)
+{
+	if (value.pixmap)
+	{
+		return *value.pixmap;
+	}
+
+	// Packed: usually drawn from the atlas. Otherwise, the copy is only kept until the next event
+	// loop iteration (valid for the current paint), not to keep the pixels twice
+	assert(value.fragment);
+	auto& copies = unpackedCopies();
+	auto it = copies.find(value.fragment);
+	if (it == copies.end())
+	{
+		if (copies.empty())
+		{
+			QTimer::singleShot(0, []()
+			{
+				unpackedCopies().clear();
+			});
+		}
+		const auto& fragment = *value.fragment;
+		QPixmap copy = QSvgIconAtlas::instance().page(fragment.page).copy(fragment.source);
+		copy.setDevicePixelRatio(fragment.devicePixelRatio);
+		it = copies.emplace(value.fragment, QSvgRasterStore::track(copy)).first;
+	}
+	return *it->second;
+}
+
+std::unordered_map<std::shared_ptr<const QSvgIconAtlas::Fragment>, std::shared_ptr<const QPixmap>>&
+	QSvgPixmapCache::unpackedCopies()
+{
+	static auto* copies = new std::unordered_map<std::shared_ptr<const QSvgIconAtlas::Fragment>,
+		std::shared_ptr<const QPixmap>>();
+	return *copies;
+}
+
+QSvgPixmapCache::QSvgPixmapCacheValue* QSvgPixmapCache::nearestValue( QSvgSizedCache& sized,
+	const QSvgPixmapCacheKey& key)
+{
+	QSvgPixmapCacheValue* sameRole = nullptr;
+	QSvgPixmapCacheValue* sameGroup = nullptr;
+	qreal sameRoleDistance = 0.0;
+	for (auto& [candidateKey, value]: sized.sizedCache)
+	{
+		if (candidateKey.group != key.group)
+		{
+			continue; // A disabled gray for an enabled icon (or the contrary) is worse than nothing
+		}
+		if (candidateKey.role == key.role)
+		{
+			const qreal distance = std::abs(candidateKey.devicePixelRatio - key.devicePixelRatio);
+			if (!sameRole || distance < sameRoleDistance)
 			{
-				assert(false);
-				throw std::runtime_error("No file is loaded to generate pixmaps.");
+				sameRole = &value;
+				sameRoleDistance = distance;
 			}
 		}
+		else if (!sameGroup || candidateKey.devicePixelRatio == key.devicePixelRatio)
+		{
+			sameGroup = &value; // Preferably at the same ratio
+		}
 	}
-	
-	const auto retIt = sizedCache.find(key);
-	if (retIt!=sizedCache.cend())
+	return sameRole ? sameRole : sameGroup;
+}
+
+QSvgRasterStore::Key QSvgPixmapCache::rasterKey( const QSize& size, const QColor& colorOverride,
+	qreal devicePixelRatio) const
+{
+	QSvgRasterStore::Key key;
+	key.contentHash = m_pixmap.contentHash();
+	key.size = size;
+	key.stretch = m_policy;
+	key.colorOverride = colorOverride;
+	key.devicePixelRatio = devicePixelRatio;
+	return key;
+}
+
+std::shared_ptr<const QPixmap> QSvgPixmapCache::sharedRaster( QSvgSizedCache& sized,
+	const QColor& colorOverride, qreal devicePixelRatio) const
+{
+	const auto& size = sized.size;
+	const auto key = rasterKey(size, colorOverride, devicePixelRatio);
+	return QSvgRasterStore::instance().acquire(key,
+		[this, &sized, &key, &size, &colorOverride, devicePixelRatio]()
+	{
+		auto& store = QSvgRasterStore::instance();
+		auto& diskCache = QSvgDiskCache::instance();
+		QImage image;
+		if (colorOverride.isValid())
+		{
+			// Tinting the coverage mask is cheaper than loading from disk, and much cheaper than
+			// rendering: the svg is only rendered once per size, whatever the number of colors.
+			const auto maskKey = rasterKey(size, QColor(), devicePixelRatio);
+			if (sized.mask && sized.mask->devicePixelRatio() != devicePixelRatio)
+			{
+				sized.mask.reset(); // Another screen: the store still shares it with other sets
+			}
+			if (!sized.mask)
+			{
+				sized.mask = store.tryAcquireMask(maskKey);
+			}
+			if (!sized.mask)
+			{
+				image = diskCache.load(key);
+			}
+			if (image.isNull())
+			{
+				if (!sized.mask)
+				{
+					sized.mask = store.acquireMask(maskKey, [this, &size, devicePixelRatio]()
+					{
+						return m_pixmap.renderMask(size, m_policy, devicePixelRatio);
+					});
+				}
+				image = QSvgPixmap::tintMask(*sized.mask, colorOverride);
+				diskCache.save(key, image);
+			}
+		}
+		else
+		{
+			image = diskCache.load(key);
+			if (image.isNull())
+			{
+				image = m_pixmap.renderImage(size, m_policy, QColor(), devicePixelRatio);
+				diskCache.save(key, image);
+			}
+		}
+		return QPixmap::fromImage(std::move(image));
+	});
+}
+
+std::shared_ptr<const QPixmap> QSvgPixmapCache::asyncRaster( QSvgSizedCache& sized,
+	const QColor& colorOverride, size_t id, qreal devicePixelRatio) const
+{
+	const auto& size = sized.size;
+	if (m_pixmap.svgData().isEmpty() || !size.isValid() || size.isEmpty())
 	{
-		assert(!retIt->second.pixmap.isNull());
-		return retIt->second.pixmap;
+		return sharedRaster(sized, colorOverride, devicePixelRatio); // Nothing to gain in background
 	}
-	if (!m_default)
+
+	auto& store = QSvgRasterStore::instance();
+	const auto maskKey = rasterKey(size, QColor(), devicePixelRatio);
+	if (colorOverride.isValid())
 	{
-		m_default = std::make_shared<QPixmap>();
+		// Once the coverage mask is available, each color is just a tint of it
+		if (sized.mask && sized.mask->devicePixelRatio() != devicePixelRatio)
+		{
+			sized.mask.reset();
+		}
+		if (!sized.mask)
+		{
+			sized.mask = store.tryAcquireMask(maskKey);
+		}
+		if (sized.mask)
+		{
+			return sharedRaster(sized, colorOverride, devicePixelRatio);
+		}
 	}
-	return *m_default;
+
+	const auto key = rasterKey(size, colorOverride, devicePixelRatio);
+	auto raster = store.tryAcquire(key);
+	if (!raster)
+	{
+		// Do not capture this: the cache may be copied or destroyed before the job finishes
+		const auto onReady = [callback=m_rasterReady, id]()
+		{
+			if (callback)
+			{
+				callback(id);
+			}
+		};
+		auto& rasterizer = QSvgAsyncRasterizer::instance();
+		if (colorOverride.isValid())
+		{
+			// The svg is rendered once per size into the mask, tinted when painted after delivery
+			rasterizer.requestMask(maskKey, m_pixmap.svgData(), onReady);
+		}
+		else
+		{
+			rasterizer.request(key, m_pixmap.svgData(), onReady);
+		}
+	}
+	return raster;
 }
 
 void QSvgPixmapCache::colorOverride(bool enable)
@@ -85,9 +700,13 @@ void QSvgPixmapCache::colorOverride(bool enable)
 		m_colorOverride = enable;
 
 		// Clear all caches
-		for (auto& [id, cache]: m_cache)
+		for (auto& [sizeId, weakSet]: m_sizedSets)
 		{
-			cache.sizedCache.clear();
+			auto sized = weakSet.lock();
+			if (sized)
+			{
+				sized->sizedCache.clear();
+			}
 		}
 	}
 }
@@ -97,24 +716,76 @@ bool QSvgPixmapCache::colorOverride() const
 	return m_colorOverride;
 }
 
+void QSvgPixmapCache::asyncRendering(bool enable)
+{
+	m_asyncRendering = enable;
+}
+
+bool QSvgPixmapCache::asyncRendering() const
+{
+	return m_asyncRendering;
+}
+
+void QSvgPixmapCache::rasterReady( const std::function<void(size_t)>& callback)
+{
+	m_rasterReady = callback;
+}
+
 bool QSvgPixmapCache::hasPixmap() const
 {
+	load();
 	return (m_pixmap.hasImage());
 }
 
+const QString& QSvgPixmapCache::loadError() const
+{
+	return m_loadError;
+}
+
+void QSvgPixmapCache::load() const
+{
+	if (m_pendingPath.isEmpty())
+	{
+		return;
+	}
+
+	QFile file(m_pendingPath);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		m_loadError = "File not accessible: " + m_pendingPath;
+	}
+	else
+	{
+		m_pixmap = QSvgPixmap(file.readAll(), QSize(), m_policy);
+		if (!m_pixmap.hasImage())
+		{
+			m_loadError = "Invalid svg: " + m_pendingPath;
+		}
+	}
+	m_pendingPath.clear();
+}
+
 
 QSvgPixmapCache::QSvgPixmapCache
 ( 
 	const QString& filePath,
-	QSvgPixmap::Stretch policy
+	QSvgPixmap::Stretch policy,
+	Load load
 ): m_policy(policy)
 {
-	QFile file(filePath);
-	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	declareId(0);
+	m_pendingPath = filePath;
+	if (load == Load::Immediate)
 	{
-		throw std::runtime_error("File not accessible.");
+		QFile file(filePath);
+		if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+		{
+			throw std::runtime_error("File not accessible.");
+		}
+		m_pendingPath.clear();
+		m_pixmap = QSvgPixmap(file.readAll(), QSize(), policy);
 	}
-	m_pixmap = QSvgPixmap(file.readAll(), QSize(), policy);
+	instances().insert(this); // Not before the exception: the destructor would not unregister
 }
 
 QSvgPixmapCache::QSvgPixmapCache
@@ -123,7 +794,9 @@ QSvgPixmapCache::QSvgPixmapCache
 	QSvgPixmap::Stretch policy
 ): m_policy(policy)
 {
+	declareId(0);
 	m_pixmap = QSvgPixmap(data, QSize(), policy);
+	instances().insert(this);
 }
 
 void QSvgPixmapCache::resize( const QSize& size, size_t id)
@@ -136,11 +809,22 @@ void QSvgPixmapCache::resize( const QSize& size, size_t id)
 		throw std::runtime_error("Accessing QSvgPixmapCache for unknown id. First declare it.");
 	}
 	
-	if (size != sizeIt->second.size)
+	auto& idCache = sizeIt->second;
+	const QSize previousSize = idCache.sized->size;
+	if (size != previousSize)
 	{
-		sizeIt->second.sizedCache.clear();
+		// Only this id moves: other ids of the previous size keep their pixmaps
+		if (idCache.pinned)
+		{
+			--idCache.sized->pins;
+		}
+		idCache.sized = sizedSet(size);
+		if (idCache.pinned)
+		{
+			++idCache.sized->pins;
+		}
+		releaseSizedSet(previousSize);
 	}
-	sizeIt->second.size = size;
 }
 
 QSize QSvgPixmapCache::size(size_t id) const
@@ -151,7 +835,7 @@ QSize QSvgPixmapCache::size(size_t id) const
 		assert(false);
 		throw std::runtime_error("Accessing QSvgPixmapCache for unknown id. First declare it.");
 	}
-	return sizeIt->second.size;
+	return sizeIt->second.sized->size;
 }
 
 
@@ -160,7 +844,10 @@ bool QSvgPixmapCache::forgetId( size_t id )
 	const auto sizeIt = m_cache.find(id);
 	if (sizeIt != m_cache.cend())
 	{
+		pinned(false, id);
+		const QSize size = sizeIt->second.sized->size;
 		m_cache.erase(sizeIt);
+		releaseSizedSet(size);
 		return true;
 	}
 	return false;
@@ -171,7 +858,7 @@ bool QSvgPixmapCache::declareId( size_t id)
 	const auto sizeIt = m_cache.find(id);
 	if (sizeIt == m_cache.cend())
 	{
-		m_cache.insert( std::make_pair(id, QSvgSizedCache{QSize(), {}}));
+		m_cache.insert( std::make_pair(id, QSvgIdCache{sizedSet(QSize()), false}));
 		return true;
 	}
 	return false;
@@ -3,9 +3,14 @@
 #ifndef QSVGPIXMAPCACHE_HPP
 #define QSVGPIXMAPCACHE_HPP
 
+#include <functional>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
+#include "QSvgIconAtlas.hpp"
 #include "QSvgPixmap.hpp"
+#include "QSvgRasterStore.hpp"
 #include <QPaletteExt.hpp>
 
 namespace Escain
@@ -20,9 +25,33 @@ namespace Escain
  * from a Group+Role -> QSvgPixmap. This makes redrawing much faster
  * at the expense of some memory.
  * 
- * Changing the OS color will triggers lazy renewal of the cache for each group/role.
+ * Changing the OS color will triggers lazy renewal of the cache for each group/role. Each cached
+ * pixmap keeps the QPaletteExt generation it was validated for, so that the check is an integer
+ * comparison until the palette changes.
  * 
  * Usually, a Cache finish by containing one pixmap for each role x group, usually 5-8 elements.
+ * Ids of the same size share the same set of pixmaps (e.g. clones of an action in several tabs):
+ * an id only refers to the set for its size, resizing an id moves it to the set of the new size.
+ * 
+ * Rendered pixmaps are shared with all other caches through QSvgRasterStore: the same svg, size
+ * and color is rendered only once for the whole process.
+ * 
+ * With colorOverride, the svg is rendered only once per size into an 8 bits coverage mask, each
+ * color is then a cheap tint of that mask: palette/theme changes does not render the svg again.
+ * 
+ * In asynchronous mode, missing pixmaps are rendered by QSvgAsyncRasterizer in worker threads (with
+ * colorOverride, only the coverage mask, once per size; colors are tinted in the GUI thread):
+ * meanwhile, pixmapFor return the nearest cached pixmap for the id (e.g. previous color) or a
+ * transparent placeholder, and the rasterReady callback is called once the pixmap is available.
+ * 
+ * All caches share the memory budget of QSvgRasterStore: when exceeded, the least recently used
+ * pixmaps of all caches are evicted (in the next event loop iteration, so that references returned
+ * by pixmapFor stay valid during a paint), except for pinned ids. Evicted pixmaps are simply
+ * rendered again on next use.
+ * 
+ * Pixmaps are also cached by device pixel ratio: on HiDPI screens, pass the ratio of the painted
+ * device to pixmapFor/fragmentFor; the pixmap is rendered with size*ratio pixels and painted sharp
+ * at the logical size. Moving a window to a screen of another ratio only renders the missing ones.
  * 
  * Note: Resizing the target pixmap will invalidate all the cache.
  */
@@ -30,23 +59,41 @@ class QSvgPixmapCache
 {
 public:
 
+	/// When the svg file is read and parsed
+	enum class Load
+	{
+		Immediate, // In the constructor, throwing if the file is not accessible
+		Deferred // On first pixmapFor or hasPixmap, failures are reported by loadError
+	};
+
 	// Default stuff
-	QSvgPixmapCache() = default;
-	QSvgPixmapCache( const QSvgPixmapCache& ) = default;
-	virtual ~QSvgPixmapCache() = default;
-	virtual QSvgPixmapCache& operator=( const QSvgPixmapCache&) = default;
+	QSvgPixmapCache();
+	QSvgPixmapCache( const QSvgPixmapCache& );
+	virtual ~QSvgPixmapCache();
+	virtual QSvgPixmapCache& operator=( const QSvgPixmapCache&);
 	
+	/// @param filepath: file or resource (":/...") path of the svg
+	/// @param load: with Load::Deferred, only the path is recorded, so that building icons which
+	///    are never shown costs nothing
 	QSvgPixmapCache( 
 		const QString& filepath,
-		QSvgPixmap::Stretch policy=QSvgPixmap::Stretch::Contain);
+		QSvgPixmap::Stretch policy=QSvgPixmap::Stretch::Contain,
+		Load load=Load::Immediate);
 
 	QSvgPixmapCache( 
 		const QByteArray& data,
 		QSvgPixmap::Stretch policy=QSvgPixmap::Stretch::Contain);
 	
 	/// get the required pixmap, eventually rendering it
+	/// @param devicePixelRatio: of the painted device, the pixmap has size()*devicePixelRatio pixels
 	virtual const QPixmap& pixmapFor(const ColorRoleExt& role, 
-		const QPaletteExt& palette, size_t id=0, bool throwIfEmpty=true) const;
+		const QPaletteExt& palette, size_t id=0, bool throwIfEmpty=true,
+		qreal devicePixelRatio=1.0) const;
+
+	/// get the location of the required pixmap in QSvgIconAtlas, eventually rendering it
+	/// Return nullptr if not available in the atlas (too large, not yet rendered...): use pixmapFor
+	virtual std::shared_ptr<const QSvgIconAtlas::Fragment> fragmentFor(const ColorRoleExt& role,
+		const QPaletteExt& palette, size_t id=0, qreal devicePixelRatio=1.0) const;
 	
 	/// Clear the cache and store the new size for new requests
 	virtual void resize( const QSize& size, size_t id=0);
@@ -61,27 +108,68 @@ public:
 	const std::vector<size_t> getAllIds() const; // O(n)
 	
 	/// Default constructed pixmap is empty, this function check if a pixmap has been set.
+	/// With Load::Deferred, the first call reads and parses the svg.
 	virtual bool hasPixmap() const;
 
+	/// Why the svg could not be loaded (file not accessible, invalid svg), empty if no error.
+	/// With Load::Deferred, errors are only known after the first pixmapFor or hasPixmap.
+	const QString& loadError() const;
+
 	virtual void colorOverride(bool enable);
 	virtual bool colorOverride() const;
 
+	/// Render missing pixmaps in background instead of blocking the caller. Disabled by default.
+	virtual void asyncRendering(bool enable);
+	virtual bool asyncRendering() const;
+
+	/// Called (in GUI thread) with the id, when a pixmap rendered in background is available.
+	/// It is usually used to repaint the widget owning that id.
+	virtual void rasterReady( const std::function<void(size_t)>& callback);
+
+	/// Render again, with the current colors of the palette, the pixmaps already cached for the id
+	/// whose color changed. Pixmaps never requested are not rendered. Ends deferColorChanges.
+	virtual void refreshColors( const QPaletteExt& palette, size_t id=0) const;
+
+	/// While deferred for the id, pixmapFor keep returning the pixmap of the previous colors after
+	/// a palette change, instead of rendering the new colors in the middle of a paint;
+	/// refreshColors render them later and ends the deferral (see QTopMenu). Other ids and caches
+	/// are not affected.
+	virtual void deferColorChanges( bool defer, size_t id=0);
+	virtual bool colorChangesDeferred( size_t id=0) const;
+
+	/// Pinned ids are never evicted to respect the memory budget (e.g. the visible widgets)
+	virtual void pinned( bool pin, size_t id=0);
+	virtual bool pinned( size_t id=0) const;
+
+	/// Release the parked rasters, then evict the least recently used pixmaps of all caches, until
+	/// the memory usage is back under 90% of the QSvgRasterStore budget. Only pixmaps whose memory
+	/// is actually freed are evicted: not shared with other caches. Packed ones are evicted by
+	/// whole atlas page, when no fragment of the page is used elsewhere (pinned, shared...), and
+	/// the page is freed. If the budget can not be met, pixmaps used since the previous eviction
+	/// are kept: they are likely on screen and would be rendered again at next paint.
+	/// Called automatically when the budget is exceeded.
+	static void evictToBudget();
+
 protected:
 
 	struct QSvgPixmapCacheKey
 	{
 		ColorRoleExt role;
 		QPalette::ColorGroup group;
+		qreal devicePixelRatio=1.0;
 		QSvgPixmapCacheKey()=default;
 		QSvgPixmapCacheKey( const QSvgPixmapCacheKey&) = default;
-		QSvgPixmapCacheKey( const ColorRoleExt& r, const QPalette::ColorGroup& c);
+		QSvgPixmapCacheKey( const ColorRoleExt& r, const QPalette::ColorGroup& c, qreal dpr=1.0);
 		bool operator==( const QSvgPixmapCacheKey& c)const;
 	};
 	
 	struct QSvgPixmapCacheValue
 	{
 		QColor color;
-		QSvgPixmap pixmap;
+		std::shared_ptr<const QPixmap> pixmap; // Shared with other caches by QSvgRasterStore
+		std::shared_ptr<const QSvgIconAtlas::Fragment> fragment; // Once packed, pixmap is released
+		quint64 generation=0; // QPaletteExt::generation for which color was last validated
+		quint64 lastUse=0; // Value of m_useClock when last returned, for eviction
 	};
 	
 	struct Hasher
@@ -93,15 +181,91 @@ protected:
 	{
 		QSize size;
 		std::unordered_map<QSvgPixmapCacheKey, QSvgPixmapCacheValue, Hasher> sizedCache;
+		std::shared_ptr<const QImage> mask; // Coverage for colorOverride (last ratio), shared by QSvgRasterStore
+		size_t pins=0; // Number of pinned ids using this set, never evicted if not 0
+	};
+
+	/// An id refers to the set of pixmaps of it size, shared with the other ids of that size
+	struct QSvgIdCache
+	{
+		std::shared_ptr<QSvgSizedCache> sized;
+		bool pinned=false;
+		bool colorsDeferred=false; // See deferColorChanges
 	};
 	
 	// This is a cache, thus, make it mutable so we can access pixmaps through const functions.
-	mutable std::unordered_map<size_t, QSvgSizedCache> m_cache = { std::make_pair(0ull, QSvgSizedCache{QSize(), {}}) };
+	mutable std::unordered_map<size_t, QSvgIdCache> m_cache;
+	/// Sets of pixmaps by size (see sizeKey), only weak: a set is freed with it last id
+	std::unordered_map<quint64, std::weak_ptr<QSvgSizedCache>> m_sizedSets;
+
+	/// The set of pixmaps for that size, shared with the other ids of the same size
+	std::shared_ptr<QSvgSizedCache> sizedSet( const QSize& size);
+	/// Remove the entry of that size from m_sizedSets if no id uses it anymore
+	void releaseSizedSet( const QSize& size);
+	/// Copy the sets of c, each cache owning it own sets (keep the sharing among ids)
+	void copySets( const QSvgPixmapCache& c);
+	static quint64 sizeKey( const QSize& size);
+
+	/// All alive caches, for eviction. Never destroyed: caches may be static too
+	static std::unordered_set<QSvgPixmapCache*>& instances();
+	/// Evict in the next event loop iteration, if not yet scheduled
+	static void scheduleEviction();
+
+	/// Read and parse the svg if its load was deferred, setting m_loadError on failure
+	void load() const;
+
+	/// Identify the raster for this svg in the QSvgRasterStore
+	QSvgRasterStore::Key rasterKey( const QSize& size, const QColor& colorOverride,
+		qreal devicePixelRatio) const;
+
+	/// Get the rendered pixmap from the QSvgRasterStore, rendering it if not yet existing.
+	/// With colorOverride, the pixmap is a tint of the coverage mask kept in sized.
+	std::shared_ptr<const QPixmap> sharedRaster( QSvgSizedCache& sized, const QColor& colorOverride,
+		qreal devicePixelRatio) const;
+
+	/// The cached value for the key, rendering it if required; lastUse is updated if current.
+	/// While being rendered in background, the nearest value (current is false), or nullptr if
+	///     none. Also nullptr if there is no svg.
+	/// @throws if the id is unknown, or if there is no svg and throwIfEmpty
+	QSvgPixmapCacheValue* valueFor(const ColorRoleExt& role, const QPaletteExt& palette, size_t id,
+		bool throwIfEmpty, qreal devicePixelRatio, bool& current) const;
+
+	/// Set value for the color: the fragment if alive in QSvgIconAtlas (counted as a store hit),
+	///     otherwise the raster from sharedRaster, or asyncRaster.
+	/// @return false if being rendered in background (value is unchanged)
+	bool renderValue( QSvgSizedCache& sized, const QColor& color, quint64 generation, size_t id,
+		qreal devicePixelRatio, QSvgPixmapCacheValue& value) const;
+
+	/// If the value is valid for the current colors of the palette. The color is only compared
+	/// when the palette generation changed since the last validation.
+	bool isCurrent( QSvgPixmapCacheValue& value, const ColorRoleExt& role, const QPaletteExt& palette) const;
+
+	/// Pixmap of the value. If packed in the atlas, a copy valid until the next event loop iteration
+	static const QPixmap& valuePixmap( QSvgPixmapCacheValue& value);
+	/// Copies made by valuePixmap, by fragment. Never destroyed: fragments can not be released
+	///     after the atlas at exit
+	static std::unordered_map<std::shared_ptr<const QSvgIconAtlas::Fragment>,
+		std::shared_ptr<const QPixmap>>& unpackedCopies();
+
+	/// Cached value to show while the one for key is rendered in background: the same role and
+	///     group at the nearest device pixel ratio, otherwise the same group. nullptr if none.
+	static QSvgPixmapCacheValue* nearestValue( QSvgSizedCache& sized, const QSvgPixmapCacheKey& key);
+
+	/// Get the rendered pixmap from the QSvgRasterStore, or nullptr after queuing it rendering
+	std::shared_ptr<const QPixmap> asyncRaster( QSvgSizedCache& sized, const QColor& colorOverride,
+		size_t id, qreal devicePixelRatio) const;
 	
 	bool m_colorOverride=true;
-	QSvgPixmap m_pixmap;
+	bool m_asyncRendering=false;
+	std::function<void(size_t)> m_rasterReady;
+	mutable QSvgPixmap m_pixmap; // Mutable for deferred load
+	mutable QString m_pendingPath; // Path not yet loaded (Load::Deferred)
+	mutable QString m_loadError;
 	QSvgPixmap::Stretch m_policy;
 	static std::shared_ptr<QPixmap> m_default; //QPixmap cannot be created before QGuiApplication...
+	static quint64 m_useClock; // Increased at each access, orders values for eviction
+	static bool m_evictionScheduled;
+	static quint64 m_lastEvictionUse; // Value of m_useClock at the end of the last eviction
 };
 
 }
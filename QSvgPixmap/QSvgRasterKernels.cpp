@@ -0,0 +1,293 @@
+// Copyright Adrian Maire, all right reserved
+
+#include "QSvgRasterKernels.hpp"
+
+#include <cstring>
+
+// SSE2 is part of x86_64: only 64 bits builds use the vectorized kernels
+#if defined(__x86_64__) || defined(_M_X64)
+	#define ESCAIN_RASTER_X86 1
+	#include <immintrin.h>
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+		#define ESCAIN_TARGET_AVX2
+	#else
+		#define ESCAIN_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+namespace Escain
+{
+
+namespace
+{
+/// Rounded x/255, exact for x in [0, 255*255]
+inline std::uint32_t div255( std::uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/// color * alpha / 255 for each channel of a premultiplied color
+inline std::uint32_t scale( std::uint32_t color, std::uint32_t alpha)
+{
+	return (div255(((color >> 24) & 0xff)*alpha) << 24) |
+		(div255(((color >> 16) & 0xff)*alpha) << 16) |
+		(div255(((color >> 8) & 0xff)*alpha) << 8) |
+		div255((color & 0xff)*alpha);
+}
+
+//*//////////// SCALAR //////////////
+void alphaFromArgbScalar( const std::uint32_t* src, std::uint8_t* dst, size_t n)
+{
+	for (size_t i=0; i<n; ++i)
+	{
+		dst[i] = static_cast<std::uint8_t>(src[i] >> 24);
+	}
+}
+
+void tintAlphaScalar( const std::uint8_t* mask, std::uint32_t* dst, size_t n, std::uint32_t color)
+{
+	for (size_t i=0; i<n; ++i)
+	{
+		dst[i] = scale(color, mask[i]);
+	}
+}
+
+void tintArgbScalar( std::uint32_t* pixels, size_t n, std::uint32_t color)
+{
+	for (size_t i=0; i<n; ++i)
+	{
+		pixels[i] = scale(color, pixels[i] >> 24);
+	}
+}
+
+#ifdef ESCAIN_RASTER_X86
+//*//////////// SSE2 //////////////
+// Channels are processed as two interleaved 16 bits lanes per pixel: blue/red and green/alpha.
+// alpha16 holds the pixel alpha in both 16 bits halves of each 32 bits pixel.
+inline __m128i scaleSSE2( __m128i colorBR, __m128i colorGA, __m128i alpha16)
+{
+	const __m128i half = _mm_set1_epi16(128);
+	__m128i br = _mm_add_epi16(_mm_mullo_epi16(colorBR, alpha16), half);
+	__m128i ga = _mm_add_epi16(_mm_mullo_epi16(colorGA, alpha16), half);
+	br = _mm_srli_epi16(_mm_add_epi16(br, _mm_srli_epi16(br, 8)), 8);
+	ga = _mm_srli_epi16(_mm_add_epi16(ga, _mm_srli_epi16(ga, 8)), 8);
+	return _mm_or_si128(br, _mm_slli_epi16(ga, 8));
+}
+
+void alphaFromArgbSSE2( const std::uint32_t* src, std::uint8_t* dst, size_t n)
+{
+	size_t i=0;
+	for (; i+16<=n; i+=16)
+	{
+		const __m128i a0 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+i)), 24);
+		const __m128i a1 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+i+4)), 24);
+		const __m128i a2 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+i+8)), 24);
+		const __m128i a3 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+i+12)), 24);
+		const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+i), packed);
+	}
+	alphaFromArgbScalar(src+i, dst+i, n-i);
+}
+
+void tintAlphaSSE2( const std::uint8_t* mask, std::uint32_t* dst, size_t n, std::uint32_t color)
+{
+	const __m128i vColor = _mm_set1_epi32(static_cast<int>(color));
+	const __m128i lowBytes = _mm_set1_epi32(0x00ff00ff);
+	const __m128i colorBR = _mm_and_si128(vColor, lowBytes);
+	const __m128i colorGA = _mm_and_si128(_mm_srli_epi16(vColor, 8), lowBytes);
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i=0;
+	for (; i+4<=n; i+=4)
+	{
+		std::int32_t fourAlphas;
+		std::memcpy(&fourAlphas, mask+i, sizeof(fourAlphas));
+		const __m128i a32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(fourAlphas), zero), zero);
+		const __m128i alpha16 = _mm_or_si128(a32, _mm_slli_epi32(a32, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+i), scaleSSE2(colorBR, colorGA, alpha16));
+	}
+	tintAlphaScalar(mask+i, dst+i, n-i, color);
+}
+
+void tintArgbSSE2( std::uint32_t* pixels, size_t n, std::uint32_t color)
+{
+	const __m128i vColor = _mm_set1_epi32(static_cast<int>(color));
+	const __m128i lowBytes = _mm_set1_epi32(0x00ff00ff);
+	const __m128i colorBR = _mm_and_si128(vColor, lowBytes);
+	const __m128i colorGA = _mm_and_si128(_mm_srli_epi16(vColor, 8), lowBytes);
+
+	size_t i=0;
+	for (; i+4<=n; i+=4)
+	{
+		__m128i* p = reinterpret_cast<__m128i*>(pixels+i);
+		const __m128i a32 = _mm_srli_epi32(_mm_loadu_si128(p), 24);
+		const __m128i alpha16 = _mm_or_si128(a32, _mm_slli_epi32(a32, 16));
+		_mm_storeu_si128(p, scaleSSE2(colorBR, colorGA, alpha16));
+	}
+	tintArgbScalar(pixels+i, n-i, color);
+}
+
+//*//////////// AVX2 //////////////
+ESCAIN_TARGET_AVX2 inline __m256i scaleAVX2( __m256i colorBR, __m256i colorGA, __m256i alpha16)
+{
+	const __m256i half = _mm256_set1_epi16(128);
+	__m256i br = _mm256_add_epi16(_mm256_mullo_epi16(colorBR, alpha16), half);
+	__m256i ga = _mm256_add_epi16(_mm256_mullo_epi16(colorGA, alpha16), half);
+	br = _mm256_srli_epi16(_mm256_add_epi16(br, _mm256_srli_epi16(br, 8)), 8);
+	ga = _mm256_srli_epi16(_mm256_add_epi16(ga, _mm256_srli_epi16(ga, 8)), 8);
+	return _mm256_or_si256(br, _mm256_slli_epi16(ga, 8));
+}
+
+ESCAIN_TARGET_AVX2 void alphaFromArgbAVX2( const std::uint32_t* src, std::uint8_t* dst, size_t n)
+{
+	// Packing works in 128 bits lanes: restore the pixel order afterwards
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	size_t i=0;
+	for (; i+32<=n; i+=32)
+	{
+		const __m256i a0 = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+i)), 24);
+		const __m256i a1 = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+i+8)), 24);
+		const __m256i a2 = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+i+16)), 24);
+		const __m256i a3 = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+i+24)), 24);
+		const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a0, a1), _mm256_packs_epi32(a2, a3));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+i), _mm256_permutevar8x32_epi32(packed, order));
+	}
+	alphaFromArgbSSE2(src+i, dst+i, n-i);
+}
+
+ESCAIN_TARGET_AVX2 void tintAlphaAVX2( const std::uint8_t* mask, std::uint32_t* dst, size_t n,
+	std::uint32_t color)
+{
+	const __m256i vColor = _mm256_set1_epi32(static_cast<int>(color));
+	const __m256i lowBytes = _mm256_set1_epi32(0x00ff00ff);
+	const __m256i colorBR = _mm256_and_si256(vColor, lowBytes);
+	const __m256i colorGA = _mm256_and_si256(_mm256_srli_epi16(vColor, 8), lowBytes);
+
+	size_t i=0;
+	for (; i+8<=n; i+=8)
+	{
+		const __m256i a32 = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask+i)));
+		const __m256i alpha16 = _mm256_or_si256(a32, _mm256_slli_epi32(a32, 16));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+i), scaleAVX2(colorBR, colorGA, alpha16));
+	}
+	tintAlphaSSE2(mask+i, dst+i, n-i, color);
+}
+
+ESCAIN_TARGET_AVX2 void tintArgbAVX2( std::uint32_t* pixels, size_t n, std::uint32_t color)
+{
+	const __m256i vColor = _mm256_set1_epi32(static_cast<int>(color));
+	const __m256i lowBytes = _mm256_set1_epi32(0x00ff00ff);
+	const __m256i colorBR = _mm256_and_si256(vColor, lowBytes);
+	const __m256i colorGA = _mm256_and_si256(_mm256_srli_epi16(vColor, 8), lowBytes);
+
+	size_t i=0;
+	for (; i+8<=n; i+=8)
+	{
+		__m256i* p = reinterpret_cast<__m256i*>(pixels+i);
+		const __m256i a32 = _mm256_srli_epi32(_mm256_loadu_si256(p), 24);
+		const __m256i alpha16 = _mm256_or_si256(a32, _mm256_slli_epi32(a32, 16));
+		_mm256_storeu_si256(p, scaleAVX2(colorBR, colorGA, alpha16));
+	}
+	tintArgbSSE2(pixels+i, n-i, color);
+}
+
+bool cpuHasAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1<<5)) != 0;
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1<<27)) != 0;
+	return avx2 && osxsave && (_xgetbv(0) & 0x6) == 0x6; // OS saves ymm registers
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // ESCAIN_RASTER_X86
+
+struct Kernels
+{
+	QSvgRasterKernels::Isa isa;
+	void (*alphaFromArgb)( const std::uint32_t*, std::uint8_t*, size_t);
+	void (*tintAlpha)( const std::uint8_t*, std::uint32_t*, size_t, std::uint32_t);
+	void (*tintArgb)( std::uint32_t*, size_t, std::uint32_t);
+};
+
+Kernels kernelsFor( QSvgRasterKernels::Isa isa)
+{
+	switch (isa)
+	{
+#ifdef ESCAIN_RASTER_X86
+		case QSvgRasterKernels::Isa::AVX2:
+			return {isa, alphaFromArgbAVX2, tintAlphaAVX2, tintArgbAVX2};
+		case QSvgRasterKernels::Isa::SSE2:
+			return {isa, alphaFromArgbSSE2, tintAlphaSSE2, tintArgbSSE2};
+#endif
+		default:
+			return {QSvgRasterKernels::Isa::Scalar, alphaFromArgbScalar, tintAlphaScalar, tintArgbScalar};
+	}
+}
+
+Kernels& kernels()
+{
+	static Kernels selected = kernelsFor(QSvgRasterKernels::bestIsa());
+	return selected;
+}
+}
+
+QSvgRasterKernels::Isa QSvgRasterKernels::bestIsa()
+{
+#ifdef ESCAIN_RASTER_X86
+	static const Isa best = cpuHasAVX2() ? Isa::AVX2 : Isa::SSE2;
+	return best;
+#else
+	return Isa::Scalar;
+#endif
+}
+
+QSvgRasterKernels::Isa QSvgRasterKernels::isa()
+{
+	return kernels().isa;
+}
+
+void QSvgRasterKernels::isa( Isa set)
+{
+	if (static_cast<int>(set) > static_cast<int>(bestIsa()))
+	{
+		set = bestIsa();
+	}
+	kernels() = kernelsFor(set);
+}
+
+void QSvgRasterKernels::alphaFromArgb( const std::uint32_t* src, std::uint8_t* dst, size_t n)
+{
+	kernels().alphaFromArgb(src, dst, n);
+}
+
+void QSvgRasterKernels::tintAlpha( const std::uint8_t* mask, std::uint32_t* dst, size_t n,
+	std::uint32_t premultipliedColor)
+{
+	kernels().tintAlpha(mask, dst, n, premultipliedColor);
+}
+
+void QSvgRasterKernels::tintArgb( std::uint32_t* pixels, size_t n, std::uint32_t premultipliedColor)
+{
+	kernels().tintArgb(pixels, n, premultipliedColor);
+}
+
+std::uint32_t QSvgRasterKernels::premultiply( std::uint32_t argb)
+{
+	const std::uint32_t alpha = argb >> 24;
+	return (alpha << 24) | (scale(argb, alpha) & 0x00ffffff);
+}
+
+}
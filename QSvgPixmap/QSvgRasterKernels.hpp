@@ -0,0 +1,55 @@
+// Copyright Adrian Maire, all right reserved
+
+#ifndef QSVGRASTERKERNELS_HPP
+#define QSVGRASTERKERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Escain
+{
+/**
+ * @brief QSvgRasterKernels
+ *
+ * Per-pixel kernels of the QSvgPixmap raster pipeline, working on premultiplied ARGB pixels
+ * (QImage::Format_ARGB32_Premultiplied, 0xAARRGGBB) and 8 bits coverage (QImage::Format_Alpha8).
+ *
+ * Each kernel is implemented in scalar, SSE2 and AVX2. The best implementation supported by the
+ * CPU is selected at runtime (first call), all implementations give identical results.
+ *
+ * Kernels process a single scan line: n pixels, no alignment required.
+ */
+class QSvgRasterKernels
+{
+public:
+	enum class Isa
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	/// Instruction set currently used by kernels
+	static Isa isa();
+	/// Best instruction set supported by this CPU (and this build)
+	static Isa bestIsa();
+	/// Force an instruction set (e.g. for benchmarks). Fall back to bestIsa() if not supported.
+	static void isa( Isa set);
+
+	/// dst[i] = alpha of src[i]
+	static void alphaFromArgb( const std::uint32_t* src, std::uint8_t* dst, size_t n);
+
+	/// dst[i] = premultipliedColor * mask[i] / 255, for each channel
+	static void tintAlpha( const std::uint8_t* mask, std::uint32_t* dst, size_t n,
+		std::uint32_t premultipliedColor);
+
+	/// pixels[i] = premultipliedColor * alpha(pixels[i]) / 255, for each channel (in-place)
+	static void tintArgb( std::uint32_t* pixels, size_t n, std::uint32_t premultipliedColor);
+
+	/// Premultiply a non-premultiplied 0xAARRGGBB color, as expected by tint kernels
+	static std::uint32_t premultiply( std::uint32_t argb);
+};
+
+}
+
+#endif //QSVGRASTERKERNELS_HPP
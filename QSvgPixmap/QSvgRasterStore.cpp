@@ -0,0 +1,312 @@
+// Copyright Adrian Maire, all right reserved
+
+#include "QSvgRasterStore.hpp"
+
+#include <algorithm>
+
+#include "QSvgIconAtlas.hpp"
+
+namespace Escain
+{
+
+namespace
+{
+	// Outside of the store: rasters still held by static caches may be freed after it at exit
+	size_t s_trackedBytes = 0;
+}
+
+bool QSvgRasterStore::Key::operator==( const Key& c) const
+{
+	return c.contentHash==contentHash && c.size==size && c.stretch==stretch &&
+		c.colorOverride==colorOverride && c.devicePixelRatio==devicePixelRatio;
+}
+
+QSize QSvgRasterStore::Key::pixelSize() const
+{
+	return QSvgPixmap::pixelSize(size, devicePixelRatio);
+}
+
+size_t QSvgRasterStore::Hasher::operator()(const Key& k) const
+{
+	size_t hash = static_cast<size_t>(k.contentHash);
+	auto combine = [&hash](size_t v)
+	{
+		hash ^= v + 0x9e3779b97f4a7c15ull + (hash<<6) + (hash>>2);
+	};
+	combine(static_cast<size_t>(k.size.width()));
+	combine(static_cast<size_t>(k.size.height()));
+	combine(static_cast<size_t>(k.stretch));
+	combine(k.colorOverride.isValid() ? static_cast<size_t>(k.colorOverride.rgba()) : 0ull);
+	combine(std::hash<qreal>()(k.devicePixelRatio));
+	return hash;
+}
+
+QSvgRasterStore& QSvgRasterStore::instance()
+{
+	static QSvgRasterStore store;
+	return store;
+}
+
+std::shared_ptr<const QPixmap> QSvgRasterStore::acquire( const Key& key,
+	const std::function<QPixmap()>& render)
+{
+	auto existing = tryAcquire(key);
+	if (existing)
+	{
+		return existing;
+	}
+
+	++m_misses;
+	auto raster = track(render());
+	m_rasters[key] = raster;
+
+	if (m_rasters.size() > m_pruneThreshold)
+	{
+		prune();
+	}
+	return raster;
+}
+
+std::shared_ptr<const QPixmap> QSvgRasterStore::tryAcquire( const Key& key)
+{
+	const auto it = m_rasters.find(key);
+	if (it == m_rasters.end())
+	{
+		return nullptr;
+	}
+
+	auto raster = it->second.lock();
+	if (raster)
+	{
+		++m_hits;
+		m_parked.erase(key); // The caller now keeps it alive
+	}
+	return raster;
+}
+
+void QSvgRasterStore::park( const Key& key, const QPixmap& raster)
+{
+	releaseStaleParked();
+
+	auto& weakRaster = m_rasters[key];
+	auto alive = weakRaster.lock();
+	if (alive)
+	{
+		return; // Already rendered by another way in the while
+	}
+
+	alive = track(raster);
+	weakRaster = alive;
+	m_parked[key] = Parked<QPixmap>{alive, Clock::now()};
+}
+
+void QSvgRasterStore::parkMask( const Key& key, const QImage& mask)
+{
+	releaseStaleParked();
+
+	auto& weakMask = m_masks[key];
+	auto alive = weakMask.lock();
+	if (alive)
+	{
+		return;
+	}
+
+	alive = track(mask);
+	weakMask = alive;
+	m_parkedMasks[key] = Parked<QImage>{alive, Clock::now()};
+}
+
+size_t QSvgRasterStore::releaseParked()
+{
+	const size_t count = m_parked.size() + m_parkedMasks.size();
+	m_parked.clear();
+	m_parkedMasks.clear();
+	return count;
+}
+
+void QSvgRasterStore::releaseStaleParked()
+{
+	const auto now = Clock::now();
+	auto releaseStale = [&now](auto& parked)
+	{
+		for (auto it = parked.begin(); it != parked.end(); /*increase in loop*/)
+		{
+			it = now - it->second.parkedAt > PARKED_LIFETIME ? parked.erase(it) : std::next(it);
+		}
+	};
+	releaseStale(m_parked);
+	releaseStale(m_parkedMasks);
+}
+
+std::shared_ptr<const QImage> QSvgRasterStore::acquireMask( const Key& key,
+	const std::function<QImage()>& render)
+{
+	auto existing = tryAcquireMask(key);
+	if (existing)
+	{
+		return existing;
+	}
+
+	++m_misses;
+	auto mask = track(render());
+	m_masks[key] = mask;
+
+	if (m_masks.size() > m_pruneThreshold)
+	{
+		prune();
+	}
+	return mask;
+}
+
+std::shared_ptr<const QImage> QSvgRasterStore::tryAcquireMask( const Key& key)
+{
+	const auto it = m_masks.find(key);
+	if (it == m_masks.end())
+	{
+		return nullptr;
+	}
+
+	auto mask = it->second.lock();
+	if (mask)
+	{
+		++m_hits;
+		m_parkedMasks.erase(key); // The caller now keeps it alive
+	}
+	return mask;
+}
+
+const QPixmap& QSvgRasterStore::placeholder( const QSize& size)
+{
+	const quint64 sizeKey = (static_cast<quint64>(static_cast<quint32>(size.width()))<<32ull) |
+		static_cast<quint32>(size.height());
+	auto it = m_placeholders.find(sizeKey);
+	if (it == m_placeholders.end())
+	{
+		QPixmap transparent(size.expandedTo(QSize(1,1)));
+		transparent.fill(Qt::transparent);
+		it = m_placeholders.emplace(sizeKey, transparent).first;
+	}
+	return it->second;
+}
+
+void QSvgRasterStore::prune()
+{
+	for (auto it = m_rasters.begin(); it != m_rasters.end(); /*increase in loop*/)
+	{
+		if (it->second.expired())
+		{
+			it = m_rasters.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	for (auto it = m_masks.begin(); it != m_masks.end(); /*increase in loop*/)
+	{
+		it = it->second.expired() ? m_masks.erase(it) : std::next(it);
+	}
+	// Amortize the cost of pruning among next insertions
+	m_pruneThreshold = std::max<size_t>(64, std::max(m_rasters.size(), m_masks.size())*2);
+}
+
+size_t QSvgRasterStore::hits() const
+{
+	return m_hits;
+}
+
+void QSvgRasterStore::addHits( size_t count)
+{
+	m_hits += count;
+}
+
+size_t QSvgRasterStore::misses() const
+{
+	return m_misses;
+}
+
+size_t QSvgRasterStore::rasterCount() const
+{
+	size_t count=0;
+	for (const auto& p: m_rasters)
+	{
+		if (!p.second.expired())
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+void QSvgRasterStore::resetCounters()
+{
+	m_hits = 0;
+	m_misses = 0;
+}
+
+std::shared_ptr<const QPixmap> QSvgRasterStore::track( const QPixmap& raster)
+{
+	const size_t bytes = static_cast<size_t>(raster.width())*static_cast<size_t>(raster.height())*
+		static_cast<size_t>(raster.depth())/8;
+	s_trackedBytes += bytes;
+	instance().updateHighWater();
+	return std::shared_ptr<const QPixmap>(new QPixmap(raster), [bytes](const QPixmap* p)
+	{
+		s_trackedBytes -= bytes;
+		delete p;
+	});
+}
+
+std::shared_ptr<const QImage> QSvgRasterStore::track( const QImage& mask)
+{
+	const size_t bytes = static_cast<size_t>(mask.sizeInBytes());
+	s_trackedBytes += bytes;
+	instance().updateHighWater();
+	return std::shared_ptr<const QImage>(new QImage(mask), [bytes](const QImage* p)
+	{
+		s_trackedBytes -= bytes;
+		delete p;
+	});
+}
+
+size_t QSvgRasterStore::memoryBudget() const
+{
+	return m_memoryBudget;
+}
+
+void QSvgRasterStore::memoryBudget( size_t bytes)
+{
+	m_memoryBudget = bytes;
+}
+
+size_t QSvgRasterStore::memoryUsage() const
+{
+	return s_trackedBytes + QSvgIconAtlas::instance().bytes();
+}
+
+size_t QSvgRasterStore::memoryHighWater() const
+{
+	return m_memoryHighWater;
+}
+
+void QSvgRasterStore::updateHighWater()
+{
+	m_memoryHighWater = std::max(m_memoryHighWater, memoryUsage());
+}
+
+bool QSvgRasterStore::overBudget() const
+{
+	return m_memoryBudget > 0 && memoryUsage() > m_memoryBudget;
+}
+
+size_t QSvgRasterStore::evictions() const
+{
+	return m_evictions;
+}
+
+void QSvgRasterStore::addEvictions( size_t count)
+{
+	m_evictions += count;
+}
+
+}
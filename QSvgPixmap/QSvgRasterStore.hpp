@@ -0,0 +1,155 @@
+// Copyright Adrian Maire, all right reserved
+
+#ifndef QSVGRASTERSTORE_HPP
+#define QSVGRASTERSTORE_HPP
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include <QColor>
+#include <QImage>
+#include <QPixmap>
+#include <QSize>
+
+#include "QSvgPixmap.hpp"
+
+namespace Escain
+{
+/**
+ * @brief QSvgRasterStore
+ *
+ * Process-wide store of rendered svg images, shared by all QSvgPixmapCache.
+ *
+ * Each QSvgPixmapCache only cache the images for it own ids, while the same svg is commonly used
+ * by many of them (same icon in several actions, group arrows, default icons...). The store
+ * identifies a rendered image by the svg content, the size, the stretch, the override color and
+ * the device pixel ratio; so that an identical image is rendered only once for the whole process.
+ *
+ * Rasters are reference-counted: the store only keeps weak references, the raster is freed as
+ * soon as no QSvgPixmapCache uses it anymore.
+ *
+ * The store also accounts the memory of all rasters, masks and atlas pages against a budget:
+ * QSvgPixmapCache evicts the least recently used pixmaps (except pinned ones) when it is exceeded.
+ *
+ * Note: QPixmap can only be used from the GUI thread, so is this store.
+ */
+class QSvgRasterStore
+{
+public:
+	/// Identify a rendered image
+	struct Key
+	{
+		quint64 contentHash=0;
+		QSize size;
+		QSvgPixmap::Stretch stretch=QSvgPixmap::Stretch::Contain;
+		QColor colorOverride; // Invalid color for no override
+		qreal devicePixelRatio=1.0;
+		bool operator==( const Key& c) const;
+		/// Size of the raster in device pixels (size is in device independent pixels)
+		QSize pixelSize() const;
+	};
+
+	struct Hasher
+	{
+		size_t operator()(const Key& k) const;
+	};
+
+	QSvgRasterStore( const QSvgRasterStore&) = delete;
+	QSvgRasterStore& operator=( const QSvgRasterStore&) = delete;
+
+	/// The store shared by the whole process
+	static QSvgRasterStore& instance();
+
+	/// Return the raster for the given key, calling render() only if it is not already alive.
+	std::shared_ptr<const QPixmap> acquire( const Key& key, const std::function<QPixmap()>& render);
+
+	/// Return the raster for the given key if alive, nullptr otherwise (never render).
+	std::shared_ptr<const QPixmap> tryAcquire( const Key& key);
+
+	/// Keep a raster rendered in background alive until it is acquired for the first time, or at
+	///     most PARKED_LIFETIME (e.g. its widget was destroyed, or changed color in the while).
+	void park( const Key& key, const QPixmap& raster);
+	/// Release all parked rasters and masks not yet acquired (freed unless used elsewhere)
+	/// @return the number of rasters and masks released
+	size_t releaseParked();
+
+	/// Return the coverage mask (Format_Alpha8) for the key, calling render() only if not alive.
+	/// Masks are kept apart from rasters: the key of a mask has no colorOverride.
+	std::shared_ptr<const QImage> acquireMask( const Key& key, const std::function<QImage()>& render);
+	/// Return the coverage mask for the given key if alive, nullptr otherwise (never render).
+	std::shared_ptr<const QImage> tryAcquireMask( const Key& key);
+	/// Keep a mask rendered in background alive until it is acquired, as park does for rasters.
+	void parkMask( const Key& key, const QImage& mask);
+
+	/// Transparent pixmap, used while the real raster is not yet available
+	const QPixmap& placeholder( const QSize& size);
+
+	/// Number of requests served by an existing raster
+	size_t hits() const;
+	/// Account requests served by a fragment alive in QSvgIconAtlas: once packed, the standalone
+	///     raster is released from the store, but it is not rendered again
+	void addHits( size_t count);
+	/// Number of requests which required to render
+	size_t misses() const;
+	/// Number of rasters currently alive in the store. O(n)
+	size_t rasterCount() const;
+	/// Reset the hits and misses counters
+	void resetCounters();
+
+	/// Memory budget in bytes for all rasters, masks and atlas pages (0 for unlimited).
+	/// Default is 64MiB. Exceeding it triggers an eviction in QSvgPixmapCache.
+	size_t memoryBudget() const;
+	void memoryBudget( size_t bytes);
+	/// Memory currently used by rasters, masks and atlas pages, in bytes
+	size_t memoryUsage() const;
+	/// Highest memoryUsage reached
+	size_t memoryHighWater() const;
+	/// Record the current memoryUsage in memoryHighWater: called wherever the usage grows (tracked
+	///     rasters and masks, atlas pages), so that peaks between two checks are not missed
+	void updateHighWater();
+	/// If memoryUsage exceeds the budget
+	bool overBudget() const;
+	/// Number of pixmaps evicted to respect the budget
+	size_t evictions() const;
+	/// Account pixmaps evicted by a cache
+	void addEvictions( size_t count);
+	/// Shared pointers whose memory is accounted in memoryUsage until they are freed
+	static std::shared_ptr<const QPixmap> track( const QPixmap& raster);
+	static std::shared_ptr<const QImage> track( const QImage& mask);
+
+private:
+	QSvgRasterStore() = default;
+
+	using Clock = std::chrono::steady_clock;
+	template<typename T>
+	struct Parked
+	{
+		std::shared_ptr<const T> raster;
+		Clock::time_point parkedAt;
+	};
+
+	/// Remove entries which are not used anymore
+	void prune();
+	/// Release the parked rasters and masks older than PARKED_LIFETIME
+	void releaseStaleParked();
+	std::unordered_map<Key, std::weak_ptr<const QPixmap>, Hasher> m_rasters;
+	std::unordered_map<Key, Parked<QPixmap>, Hasher> m_parked; // Not yet acquired
+	std::unordered_map<Key, std::weak_ptr<const QImage>, Hasher> m_masks;
+	std::unordered_map<Key, Parked<QImage>, Hasher> m_parkedMasks; // Not yet acquired
+	std::unordered_map<quint64, QPixmap> m_placeholders; // By size
+	size_t m_hits=0;
+	size_t m_misses=0;
+	size_t m_pruneThreshold=64; // Size of m_rasters triggering the removal of expired entries
+	size_t m_memoryBudget=64*1024*1024;
+	size_t m_memoryHighWater=0;
+	size_t m_evictions=0;
+
+	/// Delivery to paint usually takes one event loop iteration, keep some margin for busy ones
+	static constexpr std::chrono::seconds PARKED_LIFETIME{2};
+};
+
+}
+
+#endif //QSVGRASTERSTORE_HPP
@@ -0,0 +1,179 @@
+// Copyright Adrian Maire, all right reserved
+
+// Check QSvgDiskCache: rasters are loaded back identical, other format versions are removed when
+// the directory is set, the size cap is respected, and truncated or corrupted files are rejected
+// (and removed) instead of being loaded.
+
+#include <iostream>
+#include <string>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include "QSvgDiskCache.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+QSvgRasterStore::Key keyFor( quint64 contentHash)
+{
+	QSvgRasterStore::Key key;
+	key.contentHash = contentHash;
+	key.size = QSize(16, 16);
+	key.colorOverride = QColor(Qt::blue);
+	return key;
+}
+
+QImage imageFor( const QSvgRasterStore::Key& key)
+{
+	QImage image(key.pixelSize(), QImage::Format_ARGB32_Premultiplied);
+	image.fill(Qt::transparent);
+	for (int i=0; i<image.width(); ++i)
+	{
+		image.setPixel(i, i, key.colorOverride.rgba());
+	}
+	return image;
+}
+
+/// Cache files in the versioned directory
+QFileInfoList rasterFiles( const QString& versionDir)
+{
+	return QDir(versionDir).entryInfoList({QStringLiteral("*.raster")}, QDir::Files);
+}
+
+qint64 totalBytes( const QString& versionDir)
+{
+	qint64 total = 0;
+	for (const auto& info: rasterFiles(versionDir))
+	{
+		total += info.size();
+	}
+	return total;
+}
+
+/// Save the raster of key alone in the cache, and return its file
+QString saveAlone( QSvgDiskCache& cache, const QString& versionDir, const QSvgRasterStore::Key& key)
+{
+	cache.clear();
+	cache.save(key, imageFor(key));
+	const auto files = rasterFiles(versionDir);
+	return files.size() == 1 ? files.front().absoluteFilePath() : QString();
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QCoreApplication app( argn, argv);
+	auto& cache = QSvgDiskCache::instance();
+	const auto key = keyFor(1);
+
+	check(!cache.enabled() && !cache.save(key, imageFor(key)), "disabled without directory");
+
+	QTemporaryDir tmp;
+	const QDir base(tmp.path());
+	const QString versionDir = base.filePath(QStringLiteral("qsvgcache/v%1").arg(
+		QSvgDiskCache::FORMAT_VERSION));
+
+	// Versioning: only the other versions are removed
+	const QString oldVersion = base.filePath(QStringLiteral("qsvgcache/v%1").arg(
+		QSvgDiskCache::FORMAT_VERSION+1));
+	QDir().mkpath(oldVersion);
+	QFile(QDir(oldVersion).filePath(QStringLiteral("old.raster"))).open(QIODevice::WriteOnly);
+	QDir().mkpath(base.filePath(QStringLiteral("qsvgcache/other")));
+	QFile(base.filePath(QStringLiteral("unrelated.txt"))).open(QIODevice::WriteOnly);
+
+	cache.directory(tmp.path());
+	check(cache.enabled() && QFileInfo(versionDir).isDir(), "version directory created");
+	check(!QFileInfo::exists(oldVersion), "other version removed");
+	check(QFileInfo::exists(base.filePath(QStringLiteral("qsvgcache/other"))) &&
+		QFileInfo::exists(base.filePath(QStringLiteral("unrelated.txt"))), "other data kept");
+
+	// Round trip
+	cache.clear();
+	const QImage saved = imageFor(key);
+	check(cache.save(key, saved), "save");
+	const QImage loaded = cache.load(key);
+	check(loaded == saved, "loaded identical");
+	check(cache.load(keyFor(2)).isNull(), "other key not loaded");
+	auto otherColor = key;
+	otherColor.colorOverride = QColor(Qt::red);
+	check(cache.load(otherColor).isNull(), "other color not loaded");
+	QImage wrongSize(QSize(8, 8), QImage::Format_ARGB32_Premultiplied);
+	wrongSize.fill(Qt::transparent);
+	check(!cache.save(keyFor(3), wrongSize), "image not matching the key size not saved");
+
+	// Truncated file
+	QString path = saveAlone(cache, versionDir, key);
+	{
+		QFile file(path);
+		file.resize(file.size()-10);
+	}
+	check(cache.load(key).isNull(), "truncated: rejected");
+	check(!QFileInfo::exists(path), "truncated: removed");
+
+	// Corrupted pixels
+	path = saveAlone(cache, versionDir, key);
+	{
+		QFile file(path);
+		file.open(QIODevice::ReadWrite);
+		file.seek(file.size()-1);
+		char byte = 0;
+		file.getChar(&byte);
+		file.seek(file.size()-1);
+		file.putChar(static_cast<char>(byte ^ 0x5a));
+	}
+	check(cache.load(key).isNull(), "corrupted pixels: rejected");
+	check(!QFileInfo::exists(path), "corrupted pixels: removed");
+
+	// Corrupted header
+	path = saveAlone(cache, versionDir, key);
+	{
+		QFile file(path);
+		file.open(QIODevice::ReadWrite);
+		file.write("XXXX", 4); // Magic
+	}
+	check(cache.load(key).isNull(), "corrupted header: rejected");
+	check(!QFileInfo::exists(path), "corrupted header: removed");
+
+	saveAlone(cache, versionDir, key);
+	check(!cache.load(key).isNull(), "saved again after rejection");
+
+	// Size cap
+	cache.clear();
+	const qint64 fileBytes = QFileInfo(saveAlone(cache, versionDir, key)).size();
+	cache.clear();
+	cache.maxBytes(fileBytes*4);
+	for (quint64 i=0; i<10; ++i)
+	{
+		cache.save(keyFor(100+i), imageFor(keyFor(100+i)));
+	}
+	check(totalBytes(versionDir) <= fileBytes*4, "size cap: " + std::to_string(totalBytes(versionDir)) +
+		" bytes for a cap of " + std::to_string(fileBytes*4));
+	check(rasterFiles(versionDir).size() > 0, "size cap: files kept under the cap");
+
+	cache.maxBytes(fileBytes);
+	check(totalBytes(versionDir) <= fileBytes, "lower cap: applied immediately");
+
+	cache.clear();
+	check(rasterFiles(versionDir).isEmpty(), "clear");
+	cache.directory(QString());
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}
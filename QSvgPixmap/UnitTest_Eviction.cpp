@@ -0,0 +1,139 @@
+// Copyright Adrian Maire, all right reserved
+
+// Check QSvgPixmapCache::evictToBudget: the memory usage is brought back under 90% of the budget,
+// least recently used first, pinned ids are never evicted, also when most values are packed in
+// the atlas (only freed by whole page).
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QApplication>
+
+#include "QSvgIconAtlas.hpp"
+#include "QSvgPixmapCache.hpp"
+#include "QSvgRasterStore.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+/// Caches of distinct svgs (nothing shared among them), without colorOverride (no masks)
+std::vector<std::unique_ptr<QSvgPixmapCache>> makeCaches( size_t count, const QSize& size,
+	size_t firstColor)
+{
+	std::vector<std::unique_ptr<QSvgPixmapCache>> caches;
+	for (size_t i=0; i<count; ++i)
+	{
+		const QByteArray svg = "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"16\" height=\"16\">"
+			"<rect x=\"2\" y=\"2\" width=\"12\" height=\"12\" fill=\"#" +
+			QByteArray::number(static_cast<qulonglong>(firstColor+i), 16).rightJustified(6, '0') +
+			"\"/></svg>";
+		caches.push_back(std::make_unique<QSvgPixmapCache>(svg));
+		caches.back()->colorOverride(false);
+		caches.back()->resize(size);
+	}
+	return caches;
+}
+
+/// If the pixmap of the cache is still cached (or shared): getting it does not render
+bool kept( const QSvgPixmapCache& cache, const QPaletteExt& palette)
+{
+	auto& store = QSvgRasterStore::instance();
+	const size_t misses = store.misses();
+	cache.pixmapFor(ColorRoleExt::TextOverBackground_Normal, palette);
+	return store.misses() == misses;
+}
+
+std::string kib( size_t bytes)
+{
+	return std::to_string(bytes/1024) + "KiB";
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+	auto& store = QSvgRasterStore::instance();
+	auto& atlas = QSvgIconAtlas::instance();
+	const QPaletteExt palette(QApplication::palette());
+	const auto role = ColorRoleExt::TextOverBackground_Normal;
+
+	// Standalone pixmaps
+	{
+		store.memoryBudget(0);
+		auto caches = makeCaches(20, QSize(64, 64), 0x100);
+		caches[0]->pinned(true); // The least recently used ones
+		caches[1]->pinned(true);
+		for (const auto& cache: caches)
+		{
+			cache->pixmapFor(role, palette);
+		}
+
+		const size_t usage = store.memoryUsage();
+		check(store.memoryHighWater() >= usage, "high water: at least the usage " + kib(usage));
+		store.memoryBudget(usage/2);
+		const size_t evictions = store.evictions();
+		QSvgPixmapCache::evictToBudget();
+		const size_t target = store.memoryBudget()/10*9;
+		check(store.memoryUsage() <= target, "pixmaps: usage " + kib(store.memoryUsage()) +
+			" for a target of " + kib(target));
+		check(store.evictions() > evictions, "pixmaps: evictions counted");
+		check(store.memoryUsage() >= target - 64*64*4, "pixmaps: only evicted down to the target");
+
+		store.memoryBudget(0); // Checking renders again
+		check(kept(*caches[0], palette) && kept(*caches[1], palette), "pixmaps: pinned kept");
+		check(kept(*caches.back(), palette), "pixmaps: most recently used kept");
+		check(!kept(*caches[2], palette), "pixmaps: least recently used evicted");
+	}
+
+	// Mostly packed in the atlas: 16 icons of 256x256 per page
+	{
+		store.memoryBudget(0);
+		auto packed = makeCaches(32, QSize(256, 256), 0x200);
+		auto standalone = makeCaches(4, QSize(64, 64), 0x300);
+		for (const auto& cache: packed)
+		{
+			cache->fragmentFor(role, palette);
+		}
+		for (const auto& cache: standalone)
+		{
+			cache->pixmapFor(role, palette);
+		}
+		check(atlas.pageCount() == 2 && store.rasterCount() == 4,
+			"atlas: 2 pages and 4 standalone pixmaps");
+		packed[20]->pinned(true); // In the second page
+
+		const size_t usage = store.memoryUsage();
+		check(store.memoryHighWater() >= usage, "high water with atlas pages: at least " + kib(usage));
+		store.memoryBudget(usage*3/4);
+		QSvgPixmapCache::evictToBudget();
+		const size_t target = store.memoryBudget()/10*9;
+		check(store.memoryUsage() <= target, "atlas: usage " + kib(store.memoryUsage()) +
+			" for a target of " + kib(target));
+		check(atlas.pageCount() == 1, "atlas: least recently used page freed");
+
+		store.memoryBudget(0);
+		const size_t misses = store.misses();
+		check(packed[20]->fragmentFor(role, palette) && packed[16]->fragmentFor(role, palette) &&
+			store.misses() == misses, "atlas: page with a pinned icon kept");
+		check(kept(*standalone.back(), palette), "atlas: recent standalone pixmap kept");
+		check(!kept(*packed[0], palette), "atlas: icon of the freed page evicted");
+	}
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}
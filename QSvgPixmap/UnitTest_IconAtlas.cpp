@@ -0,0 +1,144 @@
+// Copyright Adrian Maire, all right reserved
+
+// Check QSvgIconAtlas: rasters are packed with their pixels, released slots are reused by the next
+// rasters of the same size class, and a page is freed with its last fragment. Also check that a
+// packed raster is served from the atlas to other caches, instead of being rendered again.
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <QApplication>
+
+#include "QSvgIconAtlas.hpp"
+#include "QSvgPixmapCache.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+QSvgRasterStore::Key keyFor( quint64 contentHash, const QSize& size)
+{
+	QSvgRasterStore::Key key;
+	key.contentHash = contentHash;
+	key.size = size;
+	return key;
+}
+
+QPixmap rasterFor( const QSize& size, const QColor& color)
+{
+	QPixmap raster(size);
+	raster.fill(color);
+	return raster;
+}
+
+/// If the fragment pixels in its page are all of that color
+bool hasPixels( const QSvgIconAtlas::Fragment& fragment, const QColor& color)
+{
+	const auto& page = QSvgIconAtlas::instance().page(fragment.page);
+	const QImage pixels = page.copy(fragment.source).toImage();
+	for (int y=0; y<pixels.height(); ++y)
+	{
+		for (int x=0; x<pixels.width(); ++x)
+		{
+			if (pixels.pixelColor(x, y) != color)
+			{
+				return false;
+			}
+		}
+	}
+	return pixels.size() == fragment.source.size();
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+	auto& atlas = QSvgIconAtlas::instance();
+	const QSize size(24, 24);
+
+	// Pack
+	auto a = atlas.fragmentFor(keyFor(1, size), rasterFor(size, Qt::red));
+	check(a && atlas.pageCount() == 1, "pack: one page");
+	check(a && a->source.size() == size && a->slot.height() == 32,
+		"pack: source size, slot of class 32");
+	check(a && hasPixels(*a, Qt::red), "pack: pixels copied");
+	check(atlas.fragmentFor(keyFor(1, size), rasterFor(size, Qt::blue)) == a &&
+		atlas.find(keyFor(1, size)) == a, "same key: same fragment");
+
+	auto b = atlas.fragmentFor(keyFor(2, size), rasterFor(size, Qt::green));
+	check(b && b->page == a->page && !b->slot.intersects(a->slot), "same class: same page, apart");
+	check(b && hasPixels(*b, Qt::green) && hasPixels(*a, Qt::red), "same class: pixels kept");
+
+	auto small = atlas.fragmentFor(keyFor(3, QSize(8, 8)), rasterFor(QSize(8, 8), Qt::blue));
+	check(small && small->page != a->page && atlas.pageCount() == 2, "other class: other page");
+
+	check(!atlas.fragmentFor(keyFor(4, QSize(300, 20)), rasterFor(QSize(300, 20), Qt::blue)),
+		"larger than MAX_SIZE_CLASS: not packed");
+	check(!atlas.fragmentFor(keyFor(5, size), QPixmap()), "null raster: not packed");
+
+	// Slot reuse
+	const QRect releasedSlot = b->slot;
+	b.reset();
+	check(!atlas.find(keyFor(2, size)), "released: not found anymore");
+	auto c = atlas.fragmentFor(keyFor(6, QSize(20, 24)), rasterFor(QSize(20, 24), Qt::yellow));
+	check(c && c->page == a->page && c->slot.topLeft() == releasedSlot.topLeft(),
+		"released slot reused");
+	check(c && hasPixels(*c, Qt::yellow), "reused slot: new pixels");
+	check(atlas.pageCount() == 2, "reused slot: no new page");
+
+	// Page free
+	const size_t page = a->page;
+	const size_t bytes = atlas.bytes();
+	const auto& pagePixmap = atlas.page(page);
+	const size_t pageBytes = static_cast<size_t>(pagePixmap.width())*
+		static_cast<size_t>(pagePixmap.height())*static_cast<size_t>(pagePixmap.depth())/8;
+	a.reset();
+	check(atlas.pageCount() == 2, "page kept while it has fragments");
+	c.reset();
+	check(atlas.pageCount() == 1 && atlas.page(page).isNull(), "page freed with its last fragment");
+	check(atlas.bytes() == bytes - pageBytes, "page freed: bytes " + std::to_string(atlas.bytes()));
+	auto d = atlas.fragmentFor(keyFor(7, size), rasterFor(size, Qt::red));
+	check(d && d->page == page, "freed page index reused");
+	d.reset();
+	small.reset();
+	check(atlas.pageCount() == 0 && atlas.bytes() == 0 && atlas.fragmentCount() == 0, "all released");
+
+	// Packed rasters serve all caches
+	{
+		const QByteArray svg = "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"16\" height=\"16\">"
+			"<circle cx=\"8\" cy=\"8\" r=\"6\" fill=\"#000\"/></svg>";
+		const QPaletteExt palette(QApplication::palette());
+		const auto role = ColorRoleExt::TextOverBackground_Normal;
+		QSvgPixmapCache first(svg);
+		QSvgPixmapCache second(svg);
+		first.resize(size);
+		second.resize(size);
+
+		auto& store = QSvgRasterStore::instance();
+		auto packed = first.fragmentFor(role, palette);
+		check(packed && store.rasterCount() == 0, "cache: packed, standalone raster released");
+
+		const size_t misses = store.misses();
+		const size_t hits = store.hits();
+		check(second.fragmentFor(role, palette) == packed, "other cache: same fragment");
+		check(store.misses() == misses && store.hits() == hits+1, "other cache: a hit, not rendered");
+		const QPixmap& pixmap = second.pixmapFor(role, palette);
+		check(pixmap.size() == size && store.misses() == misses, "other cache: pixmap from the atlas");
+	}
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}
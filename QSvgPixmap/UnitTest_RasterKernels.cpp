@@ -0,0 +1,169 @@
+// Copyright Adrian Maire, all right reserved
+
+// Check that the SSE2 and AVX2 kernels of QSvgRasterKernels give the same results as the scalar
+// ones, for every length (vector bodies and scalar tails) and unaligned buffers, and that the
+// scalar ones are the exact rounded color*alpha/255.
+// Instruction sets not supported by this CPU (or build) are reported and skipped.
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "QSvgRasterKernels.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+using Isa = QSvgRasterKernels::Isa;
+
+const char* isaName( Isa isa)
+{
+	switch (isa)
+	{
+		case Isa::AVX2: return "AVX2";
+		case Isa::SSE2: return "SSE2";
+		default: return "Scalar";
+	}
+}
+
+/// Exact rounded color*alpha/255, for each channel
+std::uint32_t expectedScale( std::uint32_t color, std::uint32_t alpha)
+{
+	std::uint32_t result = 0;
+	for (int shift=0; shift<32; shift+=8)
+	{
+		const std::uint32_t channel = (color >> shift) & 0xff;
+		result |= ((2*channel*alpha + 255) / 510) << shift;
+	}
+	return result;
+}
+
+constexpr size_t MAX_LENGTH = 70; // Several AVX2 bodies, and every tail length
+constexpr size_t MAX_OFFSET = 3; // Misalign the buffers
+
+struct Input
+{
+	std::vector<std::uint32_t> pixels; // Premultiplied, MAX_LENGTH+MAX_OFFSET
+	std::vector<std::uint8_t> mask;
+	std::vector<std::uint32_t> colors; // Premultiplied
+};
+
+Input makeInput()
+{
+	std::mt19937 random(42);
+	std::uniform_int_distribution<std::uint32_t> anyValue;
+	Input input;
+	for (size_t i=0; i<MAX_LENGTH+MAX_OFFSET; ++i)
+	{
+		// Random alphas, and the fully transparent and opaque ones
+		const std::uint32_t alpha = i<2 ? (i==0 ? 0u : 255u) : anyValue(random) & 0xff;
+		const std::uint32_t rgb = anyValue(random) & 0xffffff;
+		input.pixels.push_back(QSvgRasterKernels::premultiply((alpha << 24) | rgb));
+		input.mask.push_back(static_cast<std::uint8_t>(anyValue(random)));
+	}
+	input.colors = {0x00000000u, 0xffffffffu, 0xff000000u, QSvgRasterKernels::premultiply(0x80ff8040u)};
+	for (size_t i=0; i<8; ++i)
+	{
+		input.colors.push_back(QSvgRasterKernels::premultiply(anyValue(random)));
+	}
+	return input;
+}
+
+/// Results of all kernels for every length, offset and color, with the current instruction set
+struct Output
+{
+	std::vector<std::uint8_t> alpha;
+	std::vector<std::uint32_t> tintedMask;
+	std::vector<std::uint32_t> tintedPixels;
+};
+
+Output run( const Input& input)
+{
+	Output output;
+	for (size_t offset=0; offset<=MAX_OFFSET; ++offset)
+	{
+		for (size_t n=0; n<=MAX_LENGTH; ++n)
+		{
+			std::vector<std::uint8_t> alpha(n+1, 0xcd); // The extra element must be kept
+			QSvgRasterKernels::alphaFromArgb(input.pixels.data()+offset, alpha.data(), n);
+			output.alpha.insert(output.alpha.end(), alpha.begin(), alpha.end());
+
+			for (const auto color: input.colors)
+			{
+				std::vector<std::uint32_t> tinted(n+1, 0xcdcdcdcdu);
+				QSvgRasterKernels::tintAlpha(input.mask.data()+offset, tinted.data(), n, color);
+				output.tintedMask.insert(output.tintedMask.end(), tinted.begin(), tinted.end());
+
+				std::vector<std::uint32_t> pixels(input.pixels.begin()+offset,
+					input.pixels.begin()+offset+n);
+				pixels.push_back(0xcdcdcdcdu);
+				QSvgRasterKernels::tintArgb(pixels.data(), n, color);
+				output.tintedPixels.insert(output.tintedPixels.end(), pixels.begin(), pixels.end());
+			}
+		}
+	}
+	return output;
+}
+}
+
+int main (int, char *[])
+{
+	const Input input = makeInput();
+
+	// Scalar reference
+	QSvgRasterKernels::isa(Isa::Scalar);
+	check(QSvgRasterKernels::isa() == Isa::Scalar, "Scalar: selected");
+
+	bool exact = true;
+	for (const auto color: input.colors)
+	{
+		for (std::uint32_t alpha=0; alpha<256; ++alpha)
+		{
+			const std::uint8_t mask = static_cast<std::uint8_t>(alpha);
+			std::uint32_t tinted = 0;
+			QSvgRasterKernels::tintAlpha(&mask, &tinted, 1, color);
+			std::uint32_t pixel = alpha << 24;
+			QSvgRasterKernels::tintArgb(&pixel, 1, color);
+			exact = exact && tinted == expectedScale(color, alpha) && pixel == tinted;
+		}
+	}
+	check(exact, "Scalar: tint is the rounded color*alpha/255, for every alpha");
+	check(QSvgRasterKernels::premultiply(0x80ff8040u) == 0x80804020u, "premultiply");
+
+	const Output reference = run(input);
+
+	for (const auto isa: {Isa::SSE2, Isa::AVX2})
+	{
+		const std::string name = isaName(isa);
+		if (static_cast<int>(isa) > static_cast<int>(QSvgRasterKernels::bestIsa()))
+		{
+			std::cout << name << " not supported by this CPU or build: skipped" << std::endl;
+			continue;
+		}
+		QSvgRasterKernels::isa(isa);
+		check(QSvgRasterKernels::isa() == isa, name + ": selected");
+		const Output output = run(input);
+		check(output.alpha == reference.alpha, name + ": alphaFromArgb same as Scalar");
+		check(output.tintedMask == reference.tintedMask, name + ": tintAlpha same as Scalar");
+		check(output.tintedPixels == reference.tintedPixels, name + ": tintArgb same as Scalar");
+	}
+	QSvgRasterKernels::isa(QSvgRasterKernels::bestIsa());
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// Copyright Adrian Maire, all right reserved
+
+// Check that QSvgRasterStore renders an image only once for the whole process: two caches of the
+// same svg share the raster, counted as a miss for the first one and a hit for the second one.
+
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include <QApplication>
+
+#include "QSvgPixmapCache.hpp"
+#include "QSvgRasterStore.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+const QByteArray SVG = "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"16\" height=\"16\">"
+	"<rect x=\"2\" y=\"2\" width=\"12\" height=\"12\" fill=\"#000\"/></svg>";
+
+/// Hits and misses of the store during fct
+template<typename F>
+std::pair<size_t, size_t> countersFor( F fct)
+{
+	auto& store = QSvgRasterStore::instance();
+	const size_t hits = store.hits();
+	const size_t misses = store.misses();
+	fct();
+	return {store.hits() - hits, store.misses() - misses};
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+	auto& store = QSvgRasterStore::instance();
+
+	// Store alone
+	{
+		QSvgRasterStore::Key key;
+		key.contentHash = 1;
+		key.size = QSize(16, 16);
+
+		size_t renders = 0;
+		auto render = [&renders]()
+		{
+			++renders;
+			QPixmap pixmap(16, 16);
+			pixmap.fill(Qt::black);
+			return pixmap;
+		};
+
+		std::shared_ptr<const QPixmap> first;
+		std::shared_ptr<const QPixmap> second;
+		auto [hits, misses] = countersFor([&](){ first = store.acquire(key, render); });
+		check(renders == 1 && misses == 1 && hits == 0, "acquire new key: rendered, one miss");
+		std::tie(hits, misses) = countersFor([&](){ second = store.acquire(key, render); });
+		check(renders == 1 && misses == 0 && hits == 1, "acquire same key: not rendered, one hit");
+		check(first == second, "acquire same key: same raster");
+
+		auto otherKey = key;
+		otherKey.colorOverride = QColor(Qt::red);
+		auto other = store.acquire(otherKey, render);
+		check(renders == 2 && other != first, "acquire other color: rendered apart");
+
+		first.reset();
+		second.reset();
+		check(!store.tryAcquire(key), "raster freed with its last user");
+		check(store.tryAcquire(otherKey) == other, "other raster still alive");
+	}
+
+	const QPaletteExt palette(QApplication::palette());
+	const auto role = ColorRoleExt::TextOverBackground_Normal;
+
+	// Two caches without colorOverride: the second one only gets a hit
+	{
+		QSvgPixmapCache a(SVG);
+		QSvgPixmapCache b(SVG);
+		a.colorOverride(false);
+		b.colorOverride(false);
+		a.resize(QSize(24, 24));
+		b.resize(QSize(24, 24));
+
+		const QPixmap* pixmapA = nullptr;
+		const QPixmap* pixmapB = nullptr;
+		auto [hits, misses] = countersFor([&](){ pixmapA = &a.pixmapFor(role, palette); });
+		check(misses == 1 && hits == 0, "first cache: one miss, got " + std::to_string(misses));
+		std::tie(hits, misses) = countersFor([&](){ pixmapB = &b.pixmapFor(role, palette); });
+		check(misses == 0 && hits == 1, "second cache: one hit, got " + std::to_string(hits) +
+			" hits " + std::to_string(misses) + " misses");
+		check(pixmapA == pixmapB, "both caches share the raster");
+
+		std::tie(hits, misses) = countersFor([&](){ a.pixmapFor(role, palette); });
+		check(misses == 0 && hits == 0, "cached in the cache: store not asked");
+
+		const size_t before = store.rasterCount();
+		a.resize(QSize(32, 32));
+		b.resize(QSize(32, 32));
+		check(store.rasterCount() == before-1, "raster freed with the last cache using it");
+	}
+
+	// Two caches with colorOverride: the svg is rendered once into a mask, each color is a tint
+	{
+		QSvgPixmapCache a(SVG);
+		QSvgPixmapCache b(SVG);
+		a.resize(QSize(20, 20));
+		b.resize(QSize(20, 20));
+
+		auto [hits, misses] = countersFor([&](){ a.pixmapFor(role, palette); });
+		check(misses == 2, "first cache: mask and tint rendered, got " + std::to_string(misses) +
+			" misses");
+		std::tie(hits, misses) = countersFor([&](){ b.pixmapFor(role, palette); });
+		check(misses == 0 && hits == 1, "second cache, same color: one hit, got " +
+			std::to_string(hits) + " hits " + std::to_string(misses) + " misses");
+
+		const auto otherRole = ColorRoleExt::Highlight_Normal;
+		if (palette.color(otherRole) != palette.color(role))
+		{
+			std::tie(hits, misses) = countersFor([&](){ b.pixmapFor(otherRole, palette); });
+			check(misses == 1, "second cache, new color: only tinted, got " +
+				std::to_string(misses) + " misses");
+			std::tie(hits, misses) = countersFor([&](){ a.pixmapFor(otherRole, palette); });
+			check(misses == 0 && hits == 1, "first cache, that color: one hit");
+		}
+	}
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}
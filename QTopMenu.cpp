@@ -20,8 +20,10 @@
 
 #include <QCoreApplication>	// Get current path for relative paths
 #include <QDir>				// Manage relative paths for loading
+#include <QElapsedTimer>	// Bound prewarm time slices
 #include <QImage>			// Required to render the svg
 #include <QPainter>			// Required to render the svg
+#include <QPointer>			// Track groups in the prewarm queue
 
 using namespace Escain;
 
@@ -29,6 +31,7 @@ QTopMenu::QTopMenu( QWidget* parent )
 	: QWidget(parent)
 	, m_genericGroup(this)
 	, m_tabWidget(this)
+	, m_layout(*this, [this](){ return runLayout(); })
 {
 	m_genericGroup.divisionBar(true);
 	m_genericGroup.label("");
@@ -41,11 +44,13 @@ QTopMenu::QTopMenu( QWidget* parent )
 			auto tabItPrev = m_tabs.find(prev);
 			assert(tabItPrev!=m_tabs.end());
 			tabItPrev->second.setVisible(false);
+			pinTabIcons(prev, false);
 		}
 
 		auto tabItNext = m_tabs.find(next);
 		assert(tabItNext!=m_tabs.end());
 		tabItNext->second.setVisible(true);
+		pinTabIcons(next, true);
 
 		// Set focus to the first group in the selected tab
 		const auto groupIds = tabItNext->second.groupIds();
@@ -62,16 +67,25 @@ QTopMenu::QTopMenu( QWidget* parent )
 	connect(&m_tabWidget, &QTopMenuTab::updateGeometryEvent, this, [this]()
 	{
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 	});
+	connect(&m_tabWidget, &QTopMenuTab::layoutRequested, this, &QTopMenu::scheduleLayout);
 
 	connect(&m_genericGroup, &QTopMenuGridGroup::updateGeometryEvent, this, [this]()
 	{
 		m_needRecalculateGridsGeometry = true;
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 	});
+	connect(&m_genericGroup, &QTopMenuGridGroup::layoutRequested, this, &QTopMenu::scheduleLayout);
 
 	m_genericGroup.transversalCellNum(m_transversalCellNum);
 	m_genericGroup.cellSize(m_cellSize);
+	m_genericGroup.pinIcons(true); // Always visible
+	m_focusChain.insert(0, &m_genericGroup);
+
+	m_prewarmTimer.setInterval(0); // Run a slice each time the event loop is free
+	connect(&m_prewarmTimer, &QTimer::timeout, this, &QTopMenu::prewarmSlice);
 }
 
 size_t QTopMenu::transversalCellNum() const
@@ -90,6 +104,7 @@ void QTopMenu::transversalCellNum( size_t cellNum )
 		}
 		m_genericGroup.transversalCellNum(cellNum);
 		m_needRecalculateGridsGeometry = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -110,6 +125,7 @@ void QTopMenu::cellSize( qreal cellSize )
 		}
 		m_genericGroup.cellSize(cellSize);
 		m_needRecalculateGridsGeometry = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -125,6 +141,7 @@ void QTopMenu::tabMargin( qreal margin )
 	{
 		m_tabWidget.tabMargin(margin);
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -140,6 +157,7 @@ void QTopMenu::tabMinSizePercentil( qreal percentil)
 	{
 		m_tabWidget.tabMinSizePercentil(percentil);
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -156,6 +174,7 @@ void QTopMenu::showGenericGroup( bool visible )
 		m_showGenericGroup = visible;
 		m_needUpdateMinMaxSizes = true;
 		m_needRecalculateGridsGeometry = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -265,6 +284,7 @@ void QTopMenu::updateMinMaxSizes()
 	QSize sizeHintT = intermediateT;
 	sizeHintT = QSize( std::max(sizeHintT.width(), genSizeT.width()+tabSizeHintCoMaxT.width()),
 	    std::max(sizeHintT.height(), tabSizeHintCoMaxT.height()+static_cast<int>(tabHeight)));
+	const bool sizeHintChanged = (m_cachedSizeHint != transpIfVert(sizeHintT));
 	m_cachedSizeHint = transpIfVert(sizeHintT);
 
 
@@ -279,6 +299,10 @@ void QTopMenu::updateMinMaxSizes()
 		setMinimumSize( transpIfVert(minSizeT));
 		updateGeometry();
 	}
+	else if (sizeHintChanged)
+	{
+		updateGeometry(); // sizeHint is not computed on demand anymore: tell the parent layout
+	}
 
 	m_needUpdateMinMaxSizes = false;
 }
@@ -318,25 +342,305 @@ bool QTopMenu::tabLabel( const Id& menuId, const std::string& label)
 	return m_tabWidget.tabLabel(menuId, label);
 }
 
+QTopMenu::~QTopMenu()
+{
+	if (m_deferringColors)
+	{
+		deferColorChanges(false); // Widgets may outlive the menu
+	}
+}
+
+void QTopMenu::prewarm()
+{
+	startPrewarm(m_deferringColors, true);
+}
+
+void QTopMenu::refreshColors()
+{
+	// Each group and widget paints its previous colors until its refresh task ran
+	deferColorChanges(true);
+	m_deferringColors = true;
+	// An interrupted prewarm is restarted with the refresh
+	startPrewarm(true, prewarming());
+}
+
+void QTopMenu::startPrewarm( bool refresh, bool render)
+{
+	m_prewarmQueue.clear();
+
+	if (m_showGenericGroup)
+	{
+		enqueuePrewarm(m_genericGroup, refresh, render);
+	}
+
+	// Visible tab first, then the others in tab order
+	std::vector<Id> tabs{selectedId()};
+	for (const auto& tabId: m_tabOrder)
+	{
+		if (tabId != selectedId())
+		{
+			tabs.push_back(tabId);
+		}
+	}
+
+	for (const auto& tabId: tabs)
+	{
+		auto tabIt = m_tabs.find(tabId);
+		if (tabIt == m_tabs.end())
+		{
+			continue; // e.g. no tab selected yet
+		}
+		for (const auto& groupId: tabIt->second.groupIds())
+		{
+			auto* group = tabIt->second.getGroup(groupId);
+			if (group)
+			{
+				enqueuePrewarm(*group, refresh, render);
+			}
+		}
+	}
+
+	m_prewarmTotal = m_prewarmQueue.size();
+	m_prewarmTimer.start();
+}
+
+bool QTopMenu::prewarming() const
+{
+	return m_prewarmTimer.isActive();
+}
+
+void QTopMenu::enqueuePrewarm( QTopMenuGridGroup& group, bool refresh, bool render)
+{
+	// Groups and widgets may be removed before their turn comes
+	QPointer<QTopMenuGridGroup> groupPtr(&group);
+	m_prewarmQueue.push_back([groupPtr, refresh, render]()
+	{
+		if (groupPtr)
+		{
+			if (refresh)
+			{
+				groupPtr->refreshColors();
+			}
+			if (render)
+			{
+				groupPtr->prewarm();
+			}
+		}
+	});
+
+	for (const auto& widget: group.widgets())
+	{
+		std::weak_ptr<QTopMenuWidget> weakWidget = widget;
+		m_prewarmQueue.push_back([weakWidget, refresh, render]()
+		{
+			auto widgetLocked = weakWidget.lock();
+			if (widgetLocked)
+			{
+				if (refresh)
+				{
+					widgetLocked->refreshColors();
+				}
+				if (render)
+				{
+					widgetLocked->prewarm();
+				}
+			}
+		});
+	}
+}
+
+void QTopMenu::prewarmSlice()
+{
+	QElapsedTimer elapsed;
+	elapsed.start();
+
+	while (!m_prewarmQueue.empty() && elapsed.elapsed() < PREWARM_SLICE_MS)
+	{
+		auto task = std::move(m_prewarmQueue.front());
+		m_prewarmQueue.pop_front();
+		task();
+	}
+
+	emit prewarmProgress(m_prewarmTotal - m_prewarmQueue.size(), m_prewarmTotal);
+
+	if (m_prewarmQueue.empty())
+	{
+		m_prewarmTimer.stop();
+		m_deferringColors = false; // Each group and widget ended it deferral with it refresh
+		emit prewarmFinished();
+	}
+}
+
+void QTopMenu::deferColorChanges( bool defer)
+{
+	auto deferGroup = [defer](QTopMenuGridGroup& group)
+	{
+		group.deferColorChanges(defer);
+		for (const auto& widget: group.widgets())
+		{
+			widget->deferColorChanges(defer);
+		}
+	};
+
+	deferGroup(m_genericGroup);
+	for (auto& [tabId, grid]: m_tabs)
+	{
+		for (const auto& groupId: grid.groupIds())
+		{
+			auto* group = grid.getGroup(groupId);
+			if (group)
+			{
+				deferGroup(*group);
+			}
+		}
+	}
+}
+
+void QTopMenu::pinTabIcons( const Id& tabId, bool pin)
+{
+	auto tabIt = m_tabs.find(tabId);
+	if (tabIt == m_tabs.end())
+	{
+		return;
+	}
+	for (const auto& groupId: tabIt->second.groupIds())
+	{
+		auto* group = tabIt->second.getGroup(groupId);
+		if (group)
+		{
+			group->pinIcons(pin);
+		}
+	}
+}
+
+void QTopMenu::changeEvent(QEvent* e)
+{
+	QWidget::changeEvent(e);
+
+	if (e->type() == QEvent::PaletteChange || e->type() == QEvent::ApplicationPaletteChange)
+	{
+		// Do not render every icon in the middle of the next paint: see refreshColors
+		refreshColors();
+	}
+}
+
 void QTopMenu::resizeEvent(QResizeEvent*)
 {
 	m_needRecalculateGridsGeometry = true;
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 }
 
-void QTopMenu::paintEvent(QPaintEvent* e)
+bool QTopMenu::event(QEvent* e)
+{
+	if (m_layout.event(e))
+	{
+		return true;
+	}
+	return QWidget::event(e);
+}
+
+void QTopMenu::scheduleLayout()
+{
+	m_layout.schedule();
+}
+
+bool QTopMenu::runLayout()
+{
+	m_layout.inLayout(true);
+	bool done = false;
+	for (size_t round=0; round<MAX_LAYOUT_ROUNDS; ++round)
+	{
+		// Bottom-up: tab labels and generic group sizes give the grids geometry, then the grids
+		// lay out their groups, and all of them give the min/max size of this widget
+		bool changed = m_tabWidget.runLayout();
+		changed = m_genericGroup.runLayout() || changed;
+
+		if (m_needRecalculateGridsGeometry)
+		{
+			recalculateGridsGeometry();
+			changed = true;
+		}
+
+		// Hidden tabs resized meanwhile have a pending resize event, and only update their size
+		// contribution if their content changed: the cost is for the visible tab
+		for (auto& [id, grid]: m_tabs)
+		{
+			changed = grid.runLayout() || changed;
+		}
+
+		if (m_needUpdateMinMaxSizes)
+		{
+			updateMinMaxSizes();
+			changed = true;
+		}
+
+		if (!changed)
+		{
+			break;
+		}
+		done = true;
+	}
+	m_layout.inLayout(false);
+
+	if (done)
+	{
+		++m_layoutPassCount;
+	}
+	return done;
+}
+
+size_t QTopMenu::layoutPassCount() const
+{
+	return m_layoutPassCount;
+}
+
+void QTopMenu::beginUpdate()
+{
+	if (!m_layout.beginUpdate())
+	{
+		return;
+	}
+
+	// Also blocks the update() of all children
+	m_updatesWereEnabled = updatesEnabled();
+	setUpdatesEnabled(false);
+	m_focusChain.linking(false); // Linked once at endUpdate
+
+	m_genericGroup.beginUpdate();
+	for (auto& [id, grid]: m_tabs)
+	{
+		grid.beginUpdate();
+	}
+}
+
+void QTopMenu::endUpdate()
 {
-	if (m_needRecalculateGridsGeometry)
+	if (!m_layout.endUpdate())
 	{
-		recalculateGridsGeometry();
-		recalculateGridsGeometry();
+		return; // Nested (or unbalanced with beginUpdate)
 	}
 
-	if (m_needUpdateMinMaxSizes)
+	// Children request their layout to this widget: it is scheduled once, below
+	m_genericGroup.endUpdate();
+	for (auto& [id, grid]: m_tabs)
 	{
-		updateMinMaxSizes();
+		grid.endUpdate();
 	}
 
+	m_focusChain.linking(true);
+	m_layout.flush();
+
+	setUpdatesEnabled(m_updatesWereEnabled); // Repaint everything once
+}
+
+bool QTopMenu::updating() const
+{
+	return m_layout.updating();
+}
+
+void QTopMenu::paintEvent(QPaintEvent* e)
+{
 	bool isAtTop = direction()==DisplaySide::Top;
 
 	auto transposeIfVert = [isAtTop]( const auto& orig)
@@ -384,6 +688,7 @@ void QTopMenu::direction(DisplaySide dir)
 
 		m_needUpdateMinMaxSizes = true;
 		m_needRecalculateGridsGeometry = true;
+		scheduleLayout();
 		updateGeometry();
 		update();
 	}
@@ -476,14 +781,32 @@ bool QTopMenu::addGroup(const Id& menuId, const QTopMenuGridGroup::Id& groupId,
 		if (group)
 		{
 			group->label(groupId);
+			group->pinIcons(menuId == selectedId());
 		}
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 
 	return ret;
 }
 
+bool QTopMenu::addGroups(const Id& menuId, const std::vector<QTopMenuGridGroup::Id>& groupIds)
+{
+	if (m_tabs.find(menuId)==m_tabs.end())
+	{
+		return false;
+	}
+
+	UpdateGuard transaction(*this);
+	bool ret = true;
+	for (const auto& groupId: groupIds)
+	{
+		ret = addGroup(menuId, groupId) && ret;
+	}
+	return ret;
+}
+
 bool QTopMenu::removeGroup(const Id& menuId, const QTopMenuGridGroup::Id& groupId)
 {
 	auto tabIt = m_tabs.find(menuId);
@@ -497,6 +820,7 @@ bool QTopMenu::removeGroup(const Id& menuId, const QTopMenuGridGroup::Id& groupI
 	if (ret)
 	{
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 
@@ -521,6 +845,7 @@ bool QTopMenu::addItem(const Id& menuId, const QTopMenuGridGroup::Id& groupId,
 	group->addItem(widget, column, sizeHint);
 
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 	update();
 
 	return true;
@@ -544,17 +869,37 @@ bool QTopMenu::addItem(const Id& menuId, const QTopMenuGridGroup::Id& groupId,
 	group->addItem(widget, column, newColumn, heightPos, sizeHint);
 
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 	update();
 
 	return true;
 }
 
+bool QTopMenu::addItems(const Id& menuId, const QTopMenuGridGroup::Id& groupId,
+    const std::vector<NewItem>& items)
+{
+	auto tabIt = m_tabs.find(menuId);
+	if (tabIt==m_tabs.end() || !tabIt->second.getGroup(groupId))
+	{
+		return false;
+	}
+
+	UpdateGuard transaction(*this);
+	bool ret = true;
+	for (const auto& item: items)
+	{
+		ret = addItem(menuId, groupId, item.widget, item.column, item.sizeHint) && ret;
+	}
+	return ret;
+}
+
 void QTopMenu::addGenericItem(std::shared_ptr<QTopMenuWidget> widget,
     size_t column, const QSizeF& sizeHint)
 {
 	m_genericGroup.addItem(widget, column, sizeHint);
 	m_needUpdateMinMaxSizes = true;
 	m_needRecalculateGridsGeometry = true;
+	scheduleLayout();
 	update();
 }
 
@@ -564,6 +909,7 @@ void QTopMenu::addGenericItem(std::shared_ptr<QTopMenuWidget> widget,
 	m_genericGroup.addItem(widget, column, newColumn, heightPos, sizeHint);
 	m_needUpdateMinMaxSizes = true;
 	m_needRecalculateGridsGeometry = true;
+	scheduleLayout();
 	update();
 }
 
@@ -607,6 +953,7 @@ bool QTopMenu::removeItem( const Id& menuId, const QTopMenuGridGroup::Id& groupI
 
 	const auto ret = group->removeItem(column, heightPos);
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 	update();
 	return ret;
 }
@@ -616,6 +963,7 @@ bool QTopMenu::removeGenericItem( size_t column, size_t heightPos)
 	const auto ret = m_genericGroup.removeItem(column, heightPos);
 	m_needUpdateMinMaxSizes = true;
 	m_needRecalculateGridsGeometry = true;
+	scheduleLayout();
 	update();
 	return ret;
 }
@@ -645,10 +993,22 @@ bool QTopMenu::insertTab(const Id& id, const QString& name, int pos)
 	newTabObj.setVisible(false);
 	m_tabWidget.insertTab(id, name, pos);
 
+	connect(&newTabObj, &QTopMenuGrid::updateGeometryEvent, this, [this]()
+	{
+		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
+	});
+	connect(&newTabObj, &QTopMenuGrid::layoutRequested, this, &QTopMenu::scheduleLayout);
+	if (m_layout.updating())
+	{
+		newTabObj.beginUpdate(); // Ended with the others, see endUpdate
+	}
+
 	m_needUpdateMinMaxSizes = true;
 	m_needRecalculateGridsGeometry = true;
+	scheduleLayout();
 
-	updateFocusOrder();
+	m_focusChain.insert(1+checkedPos, &newTabObj);
 	return true;
 }
 
@@ -666,6 +1026,7 @@ bool QTopMenu::removeTab(const Id& tabId)
 		return false;
 	}
 
+	m_focusChain.remove(&it->second);
 	m_tabs.erase(it);
 	auto orderIt = std::find(m_tabOrder.begin(), m_tabOrder.end(), tabId);
 	if (orderIt != m_tabOrder.cend())
@@ -676,26 +1037,15 @@ bool QTopMenu::removeTab(const Id& tabId)
 
 	m_needUpdateMinMaxSizes = true;
 	m_needRecalculateGridsGeometry = true;
-	updateFocusOrder();
+	scheduleLayout();
 
 	return true;
 }
 
-void QTopMenu::updateFocusOrder()
-{
-	for (auto& [id, tabGrid]: m_tabs)
-	{
-		setTabOrder(&m_genericGroup, &tabGrid);
-	}
-}
-
 QSize QTopMenu::sizeHint() const
 {
-	if (m_needUpdateMinMaxSizes)
-	{
-		// Cache needs to be updated, but sizeHint is still const
-		const_cast<QTopMenu*>(this)->updateMinMaxSizes();
-	}
+	// Value of the layout pass, run now if pending (e.g. asked before the posted request)
+	m_layout.ensure();
 	return m_cachedSizeHint;
 
 }
@@ -19,13 +19,18 @@
 #ifndef QTOPMENU_HPP
 #define QTOPMENU_HPP
 
+#include <deque>
+#include <functional>
 #include <string>
 #include <unordered_map>
 
 #include <QStaticText>
+#include <QTimer>
 #include <QWidget>
 
 #include <QClickManager.hpp>
+#include <QFocusChain.hpp>
+#include <QLayoutScheduler.hpp>
 #include "QTopMenuGrid.hpp"
 #include "QTopMenuTab.hpp"
 #include "QTopMenuWidgetTypes.hpp"
@@ -62,7 +67,7 @@ public:
 	using Id = std::string;
 
 	explicit QTopMenu( QWidget* parent=nullptr );
-	virtual ~QTopMenu() = default;
+	virtual ~QTopMenu();
 
 	//*//////////// GENERAL PROPERTIES //////////
 	virtual void direction(DisplaySide dir);
@@ -250,25 +255,117 @@ public:
 	virtual bool removeItem( const Id& menuId, const QTopMenuGridGroup::Id& groupId,
 	    size_t column, size_t heightPos);
 
+	/// A widget to add with addItems
+	struct NewItem
+	{
+		std::shared_ptr<QTopMenuWidget> widget;
+		size_t column;
+		QSizeF sizeHint;
+	};
+	/// Add several widgets to a group in one transaction (see beginUpdate), each one as addItem
+	///     without heightPos: at the last position of its column.
+	/// @return true if all items were added (false if the tab or the group does not exist, or any
+	///     item was not added by addItem, the others are still added)
+	/// @throws if a widget cold not be inserted (e.g. invalid values)
+	virtual bool addItems( const Id& menuId, const QTopMenuGridGroup::Id& groupId,
+	    const std::vector<NewItem>& items);
+
+	/// Add several groups at the end of the given menu in one transaction (see beginUpdate)
+	/// @return true if all groups were added (false if the tab does not exist or a group
+	///     already existed, the others are still added)
+	virtual bool addGroups( const Id& menuId, const std::vector<QTopMenuGridGroup::Id>& groupIds);
+
+	//*//////////// TRANSACTIONS //////////////
+	/// Defer the layout, focus order and repaint work of all modifications until the matching
+	///     endUpdate, which does each once: building a menu of N items is then linear instead of
+	///     quadratic. Calls can be nested, only the outermost endUpdate commits.
+	/// Prefer UpdateGuard, which can not forget the endUpdate.
+	virtual void beginUpdate();
+	virtual void endUpdate();
+	/// Return true between beginUpdate and the matching endUpdate
+	bool updating() const;
+
+	/// RAII transaction: beginUpdate on construction and endUpdate on destruction
+	class UpdateGuard
+	{
+	public:
+		explicit UpdateGuard( QTopMenu& menu ): m_menu(menu) { m_menu.beginUpdate(); }
+		~UpdateGuard() { m_menu.endUpdate(); }
+		UpdateGuard( const UpdateGuard&) = delete;
+		UpdateGuard& operator=( const UpdateGuard&) = delete;
+	private:
+		QTopMenu& m_menu;
+	};
+
+	//*//////////// ICONS PRE-RENDERING //////////////
+	/// Render in advance the icons of all tabs, groups and widgets for each state, so that the first
+	///     tab switch, hover or press does not stall. The selected tab is rendered first.
+	/// The work is split in time slices in the event loop, see prewarmProgress/prewarmFinished.
+	/// Calling it again restart the pre-rendering (e.g. after adding items).
+	virtual void prewarm();
+
+	/// Return true while a prewarm is in progress
+	bool prewarming() const;
+
+	/// Render again the icons already rendered, whose colors changed with the palette. Called
+	///     automatically on palette changes (e.g. OS theme switch).
+	/// Meanwhile, widgets keep painting their previous colors: the visible tab is rendered first
+	///     and the others are spread in time slices as prewarm does (same signals are emitted).
+	virtual void refreshColors();
+
 	//*//////////// OTHERS //////////////
-	/// See Qt sizeHint
+	/// See Qt sizeHint. The pending layout pass, if any, is run first (except while painting)
 	QSize sizeHint() const override;
+
+	/// Run now the pending layout of the tabs, groups and widgets, if any.
+	/// Property changes only mark what needs a layout: a single pass runs in the next event loop
+	///     iteration, before painting. Call it to get the geometry immediately (e.g. in tests).
+	/// @return true if anything was laid out
+	virtual bool runLayout();
+
+	/// Number of layout passes which did some work since creation. Several changes in the same
+	///     event loop iteration are expected to count once.
+	size_t layoutPassCount() const;
+
+signals:
+	/// Emitted after each time slice of prewarm or refreshColors: done over total elements
+	///     (widgets and groups)
+	void prewarmProgress( size_t done, size_t total);
+	/// Emitted once all icons are pre-rendered (or rendered again for refreshColors)
+	void prewarmFinished();
 	
 protected:
 	void resizeEvent(QResizeEvent * event) override;
 	void paintEvent(QPaintEvent* e) override;
+	void changeEvent(QEvent* e) override;
+	bool event(QEvent* e) override;
 
+	/// Request a layout pass before the next paint. Coalesced: several requests, one pass.
+	void scheduleLayout();
 	/// Set/update the minimum/maximum size
 	virtual void updateMinMaxSizes();
 	/// Update the position of all QTopMenuGrid widgets and general QTopMenuGridGroup.
 	virtual void recalculateGridsGeometry();
-	/// Set the order of focus (tab order) between sub-widgets
-	virtual void updateFocusOrder();
+	/// Pre-render the next elements of the prewarm queue, during PREWARM_SLICE_MS
+	virtual void prewarmSlice();
+	/// Fill the prewarm queue with all groups and widgets, the selected tab first, and start it
+	/// @param refresh: refresh the colors of already rendered icons (see refreshColors)
+	/// @param render: render in advance the icons (see prewarm)
+	void startPrewarm( bool refresh, bool render);
+	/// Protect (or not) the icons of all groups of the tab from eviction (memory budget)
+	void pinTabIcons( const Id& tabId, bool pin);
+	/// Keep (or not) the previous colors of all groups and widgets of this menu, until each one
+	///     is refreshed. Other menus and icons are not affected.
+	void deferColorChanges( bool defer);
+	/// Append to the prewarm queue the group and all it widgets
+	void enqueuePrewarm( QTopMenuGridGroup& group, bool refresh, bool render);
 	
 	std::unordered_map<Id, QTopMenuGrid> m_tabs; // Assume all Ids are there and valid.
 	std::vector<Id> m_tabOrder;
 
 	QTopMenuGridGroup m_genericGroup;
+	///@brief Order of focus (tab order): the generic group, then the tabs in m_tabOrder
+	QFocusChain m_focusChain;
 	bool m_showGenericGroup=true;
 
 	QTopMenuTab m_tabWidget;
@@ -285,10 +382,28 @@ protected:
 	///@brief cache sizeHint value
 	QSize m_cachedSizeHint = QSize(0,0);
 
+	///@brief coalesced layout requests and transactions (mutable: sizeHint runs the pending pass)
+	mutable QLayoutScheduler m_layout;
+	///@brief see layoutPassCount
+	size_t m_layoutPassCount = 0;
+
+	///@brief updatesEnabled before the outermost beginUpdate, restored by endUpdate
+	bool m_updatesWereEnabled = true;
+
 	///@brief Number of cells perpendicular to the direction; used for general and tab grids
 	size_t m_transversalCellNum = 3;
 	///@brief Size of one-side of the cell (square); used for general and tab grids
 	qreal m_cellSize = 25.0;
+
+	///@brief Pending pre-rendering tasks, and the total number at prewarm start
+	std::deque<std::function<void()>> m_prewarmQueue;
+	size_t m_prewarmTotal = 0;
+	QTimer m_prewarmTimer;
+	///@brief If this menu is deferring the color changes of icons until refreshed
+	bool m_deferringColors = false;
+
+	static constexpr int PREWARM_SLICE_MS = 8; // Time given to prewarm in each event loop iteration
+	static constexpr size_t MAX_LAYOUT_ROUNDS = 4; // Bound the rounds of a pass until geometry is stable
 };
 }
 
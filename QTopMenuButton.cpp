@@ -20,6 +20,7 @@
 
 #include <QWidget>
 #include <QPainter>
+#include <QPointer>
 
 #include <QTopMenuButtonWidget.hpp>
 
@@ -28,6 +29,7 @@ using namespace Escain;
 QTopMenuButton::QTopMenuButton(): QObject(), QTopMenuAction()
 {
 	m_icon.forgetId(0); // by default 0 is added.
+	repaintOnRasterReady();
 }
 
 QTopMenuButton::~QTopMenuButton()
@@ -48,10 +50,11 @@ std::shared_ptr<QTopMenuWidget> QTopMenuButton::createWidget( QWidget* parent )
 	auto but = std::make_shared<QTopMenuButtonWidget>(nameId(), id, parent);
 
 	//but->connect(but.get(), &QTopMenuButtonWidget::clicked, this, &QTopMenuButton::triggered); //TODO recover and remove next
-	but->connect(but.get(), &QTopMenuButtonWidget::clicked, this, [this](const QPointF& , const std::unordered_set<size_t>&, QTopMenuButtonWidget* me){ emit triggered(me);});
+	but->connect(but.get(), &QTopMenuButtonWidget::clicked, this, [this](const QPointF& , const QClickIdSet&, QTopMenuButtonWidget* me){ emit triggered(me);});
 	but->connect(but.get(), &QTopMenuButtonWidget::bestSizeChanged, this, &QTopMenuButton::bestSizeChanged);
 	
 	m_widgetVector.push_back(but);
+	but->sizeCache(m_sizeCache); // All clones have the same label and margin: same best sizes
 	but->label(m_label);
 	but->margin(m_margin);
 	but->icon(&m_icon);
@@ -62,6 +65,7 @@ std::shared_ptr<QTopMenuWidget> QTopMenuButton::createWidget( QWidget* parent )
 void QTopMenuButton::icon(const QSvgIcon& ic)
 {
 	m_icon = ic;
+	repaintOnRasterReady();
 	for (auto& butPtr: m_widgetVector)
 	{
 		auto ptr = std::static_pointer_cast<QTopMenuButtonWidget>(butPtr);
@@ -75,11 +79,33 @@ const QSvgIcon& QTopMenuButton::icon() const
 	return m_icon;
 }
 
+void QTopMenuButton::repaintOnRasterReady()
+{
+	// The rendering may finish after this button is destroyed
+	QPointer<QTopMenuButton> self(this);
+	m_icon.rasterReady([self](size_t id)
+	{
+		if (!self)
+		{
+			return;
+		}
+		for (auto& butPtr: self->m_widgetVector)
+		{
+			auto ptr = std::static_pointer_cast<QTopMenuButtonWidget>(butPtr);
+			if (ptr && ptr->id() == id)
+			{
+				ptr->update();
+			}
+		}
+	});
+}
+
 void QTopMenuButton::label( const std::string& label)
 {
 	if( m_label != label)
 	{
 		m_label = label;
+		m_sizeCache->clear(); // Candidates of the previous label won't be used anymore
 		for (auto& butPtr: m_widgetVector)
 		{
 			auto ptr = std::static_pointer_cast<QTopMenuButtonWidget>(butPtr);
@@ -99,6 +125,7 @@ void QTopMenuButton::margin( const qreal margin)
 	if( m_margin != margin)
 	{
 		m_margin = margin;
+		m_sizeCache->clear();
 		for (auto& butPtr: m_widgetVector)
 		{
 			auto ptr = std::static_pointer_cast<QTopMenuButtonWidget>(butPtr);
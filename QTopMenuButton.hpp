@@ -66,11 +66,16 @@ signals:
 	/// Emitted when the size of the widget requires to be requested and applied.
 	void bestSizeChanged();
 protected:
+	/// Repaint the widget using the icon when it is rendered in background
+	void repaintOnRasterReady();
+
 	//QAction m_action;
 	QSvgIcon m_icon;
 	std::string m_label;
 	bool m_enabled=true;
 	qreal m_margin = 2.0;
+	/// bestSize candidates shared by all widgets of this button
+	std::shared_ptr<QTopMenuButtonSizeCache> m_sizeCache = std::make_shared<QTopMenuButtonSizeCache>();
 	
 	// Auto counter to represent each widget. Helping managing ids for QSvgIcon cache.
 	size_t m_idAutocounter=0;
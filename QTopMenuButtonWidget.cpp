@@ -20,6 +20,7 @@
 
 #include <cmath>
 
+#include <QFontMetricsCache.hpp>
 #include <QPaletteExt.hpp>
 #include <QSvgIcon.hpp>
 
@@ -44,7 +45,7 @@ QTopMenuButtonWidget::QTopMenuButtonWidget(const std::string& name, size_t id, Q
 	m_clickManager.enableHover(*this);
 	
 	connect(&m_clickManager, &QClickManager::clicked,
-	[this](const QPointF& cursorPos, const std::unordered_set<size_t>& clickableRectangleIds)
+	[this](const QPointF& cursorPos, const QClickIdSet& clickableRectangleIds)
 	{
 		if (isEnabled())
 		{
@@ -82,8 +83,7 @@ QTopMenuBuggonWidgetLayout QTopMenuButtonWidget::detectLayout(const QSize& currS
 {
 	QFont font;
 	staticSetupFontForLabel(font);
-	QFontMetrics metrics(font);
-	qreal estCellSize = metrics.height()*1.2;
+	qreal estCellSize = QFontMetricsCache::instance().height(font)*1.2;
 
 	if (static_cast<qreal>(currSize.width()) / static_cast<qreal>(currSize.height()) >=2.0)
 	{
@@ -145,8 +145,7 @@ QRectF QTopMenuButtonWidget::iconRect(const QRect& widgetRect, const QTopMenuBug
 			{
 				QFont font;
 				staticSetupFontForLabel(font);
-				QFontMetrics metrics(font);
-				qreal side = widgetRect.height()-metrics.height();
+				qreal side = widgetRect.height()-QFontMetricsCache::instance().height(font);
 				iconRect = QRectF(QPointF(0.0, 0.0), QSize(side, side));
 			}
 			else
@@ -168,14 +167,14 @@ QRect QTopMenuButtonWidget::textRect() const
 {
 	QFont font;
 	staticSetupFontForLabel(font);
-	QFontMetrics metrics(font);
-	const auto qLabel = elidedText(metrics, m_cachedLayout, QString::fromUtf8(m_label.c_str()), size(), m_margin);
-	return textRect( rect(), m_margin, metrics, qLabel, m_cachedLayout);
+	const auto qLabel = elidedText(font, m_cachedLayout, QString::fromUtf8(m_label.c_str()), size(), m_margin);
+	return textRect( rect(), m_margin, font, qLabel, m_cachedLayout);
 }
 
-QRect QTopMenuButtonWidget::textRect(const QRect& widgetRect, qreal margin, const QFontMetrics& metrics, const QString& label, const QTopMenuBuggonWidgetLayout layout)
+QRect QTopMenuButtonWidget::textRect(const QRect& widgetRect, qreal margin, const QFont& font, const QString& label, const QTopMenuBuggonWidgetLayout layout)
 {
-	QSizeF textSize = QSizeF(metrics.horizontalAdvance(label),metrics.height());
+	auto& measures = QFontMetricsCache::instance();
+	QSizeF textSize = QSizeF(measures.horizontalAdvance(font, label), measures.height(font));
 
 	if (layout == QTopMenuBuggonWidgetLayout::Big)
 	{
@@ -296,9 +295,8 @@ void QTopMenuButtonWidget::staticDrawControl( const QTopMenuButtonWidgetStyleOpt
 			QFont font = p.font();
 			staticSetupFontForLabel(font);
 			p.setFont(font);
-			QFontMetrics metrics(font);
 
-			const QRectF textR = textRect(opt.widgetRect, opt.margin, metrics, opt.staticText->text(), opt.layout);
+			const QRectF textR = textRect(opt.widgetRect, opt.margin, font, opt.staticText->text(), opt.layout);
 			assert(opt.staticText);
 			p.drawStaticText( textR.topLeft().toPoint(), *opt.staticText);
 
@@ -329,9 +327,10 @@ void QTopMenuButtonWidget::resizeEvent(QResizeEvent *)
 	m_recomputeSizeNeeded=true;
 }
 
-QString QTopMenuButtonWidget::elidedText( const QFontMetrics& metrics, const QTopMenuBuggonWidgetLayout layout,
+QString QTopMenuButtonWidget::elidedText( const QFont& font, const QTopMenuBuggonWidgetLayout layout,
     const QString& str, const QSize& widgetSize, const qreal margin) const
 {
+	auto& measures = QFontMetricsCache::instance();
 	switch (layout)
 	{
 		case QTopMenuBuggonWidgetLayout::Small:
@@ -340,11 +339,11 @@ QString QTopMenuButtonWidget::elidedText( const QFontMetrics& metrics, const QTo
 		}break;
 		case QTopMenuBuggonWidgetLayout::Big:
 		{
-			return metrics.elidedText(str, Qt::TextElideMode::ElideMiddle, widgetSize.width()-2*margin);
+			return measures.elidedText(font, str, Qt::TextElideMode::ElideMiddle, widgetSize.width()-2*margin);
 		}break;
 		case QTopMenuBuggonWidgetLayout::Horizontal:
 		{
-			return metrics.elidedText(str, Qt::TextElideMode::ElideMiddle, widgetSize.width()- margin - widgetSize.height());
+			return measures.elidedText(font, str, Qt::TextElideMode::ElideMiddle, widgetSize.width()- margin - widgetSize.height());
 		}
 	}
 	return "";
@@ -359,8 +358,7 @@ void QTopMenuButtonWidget::recomputeSize()
 	auto qLabel = QString::fromUtf8(m_label.c_str());
 	QFont font;
 	setupFontForLabel(font);
-	QFontMetrics metrics(font);
-	QString elidedLabel = elidedText(metrics, m_cachedLayout, qLabel, size(),m_margin);
+	QString elidedLabel = elidedText(font, m_cachedLayout, qLabel, size(),m_margin);
 	m_staticText.setText(elidedLabel); //TODO document utf8
 	m_iconRect = iconRect().toRect();
 
@@ -395,8 +393,72 @@ void QTopMenuButtonWidget::keyPressEvent(QKeyEvent *e)
 	}
 }
 
-std::optional<QSizeF> QTopMenuButtonWidget::bestSize([[maybe_unused]] DisplaySide dir,
+bool QTopMenuButtonSizeCache::Key::operator==( const Key& c) const
+{
+	return c.direction==direction && c.cellSize==cellSize && c.cellMargin==cellMargin &&
+		c.transversalCellNum==transversalCellNum && c.margin==margin &&
+		c.fontGeneration==fontGeneration && c.label==label && c.font==font;
+}
+
+const std::vector<QSizeF>* QTopMenuButtonSizeCache::find( const Key& key)
+{
+	for (const auto& entry: m_entries)
+	{
+		if (entry.first == key)
+		{
+			++m_hits;
+			return &entry.second;
+		}
+	}
+	++m_misses;
+	return nullptr;
+}
+
+const std::vector<QSizeF>& QTopMenuButtonSizeCache::insert( Key key, std::vector<QSizeF> candidates)
+{
+	if (m_entries.size() >= MAX_ENTRIES)
+	{
+		m_entries.erase(m_entries.begin()); // Oldest
+	}
+	m_entries.emplace_back(std::move(key), std::move(candidates));
+	return m_entries.back().second;
+}
+
+void QTopMenuButtonSizeCache::clear()
+{
+	m_entries.clear();
+}
+
+void QTopMenuButtonWidget::sizeCache( std::shared_ptr<QTopMenuButtonSizeCache> cache)
+{
+	assert(cache);
+	m_sizeCache = std::move(cache);
+}
+
+const std::shared_ptr<QTopMenuButtonSizeCache>& QTopMenuButtonWidget::sizeCache() const
+{
+	return m_sizeCache;
+}
+
+std::optional<QSizeF> QTopMenuButtonWidget::bestSize(DisplaySide dir,
     const CellInfo& cellInfo, const QSizeF& sizeHint, const QSizeF& maxSize) const
+{
+	QFont font;
+	staticSetupFontForLabel(font);
+
+	QTopMenuButtonSizeCache::Key key{dir, cellInfo.cellSize, cellInfo.margin, cellInfo.transversalCellNum,
+		m_label, m_margin, font.key(), QFontMetricsCache::instance().generation()};
+	const auto* candidates = m_sizeCache->find(key);
+	if (!candidates)
+	{
+		candidates = &m_sizeCache->insert(std::move(key), candidateSizes(dir, cellInfo, font));
+	}
+
+	return bestSizeBetweenPossibles( *candidates, sizeHint, maxSize);
+}
+
+std::vector<QSizeF> QTopMenuButtonWidget::candidateSizes( DisplaySide dir, const CellInfo& cellInfo,
+    const QFont& font) const
 {
 	auto overlappedCells = [&cellInfo](qreal size) -> qreal
 	{
@@ -414,10 +476,8 @@ std::optional<QSizeF> QTopMenuButtonWidget::bestSize([[maybe_unused]] DisplaySid
 		return cellNumR*cellInfo.cellSize + std::max(cellNumR-1.0, 0.0)*cellInfo.margin;
 	};
 
-	QFont font;
-	staticSetupFontForLabel(font);
-	QFontMetrics metrics(font);
-	qreal fontHeight = metrics.height() * 1.5;
+	const qreal labelHeight = QFontMetricsCache::instance().height(font);
+	qreal fontHeight = labelHeight * 1.5;
 
 	qreal estCellRatio = std::round(overlappedCells(fontHeight));
 
@@ -439,7 +499,7 @@ std::optional<QSizeF> QTopMenuButtonWidget::bestSize([[maybe_unused]] DisplaySid
 	for ( auto& s: candidates)
 	{
 		const auto layout = detectLayout(s.toSize());
-		QString qlabel = elidedText(metrics, layout, QString::fromUtf8(m_label.c_str()), s.toSize(), m_margin);
+		QString qlabel = elidedText(font, layout, QString::fromUtf8(m_label.c_str()), s.toSize(), m_margin);
 		QRect r = QRect(QPoint(0,0), s.toSize());
 		const auto& iconR = iconRect(r, layout, dir);
 
@@ -448,7 +508,7 @@ std::optional<QSizeF> QTopMenuButtonWidget::bestSize([[maybe_unused]] DisplaySid
 			continue; //no text, no modifications to width
 		}
 
-		const auto& textR = textRect(r, m_margin, metrics, qlabel, layout);
+		const auto& textR = textRect(r, m_margin, font, qlabel, layout);
 		if (layout == QTopMenuBuggonWidgetLayout::Horizontal)
 		{
 			//Some instability between QFontMetrics::horizontalAdvance and elideText-> add 1.0
@@ -471,12 +531,49 @@ std::optional<QSizeF> QTopMenuButtonWidget::bestSize([[maybe_unused]] DisplaySid
 			}
 			else
 			{
-				s.setHeight(s.height()+metrics.height()+m_margin);
+				s.setHeight(s.height()+labelHeight+m_margin);
 			}
 		}
 	}
 
-	return bestSizeBetweenPossibles( candidates, sizeHint, maxSize);
+	return candidates;
+}
+
+void QTopMenuButtonWidget::prewarm()
+{
+	// Hidden widgets does not receive resizeEvent (it is postponed until shown): always recompute
+	recomputeSize();
+
+	if (nullptr != m_icon && m_icon->hasIcon())
+	{
+		m_icon->prewarm(QPaletteExt(QWidget::palette()), id(), devicePixelRatioF());
+	}
+}
+
+void QTopMenuButtonWidget::refreshColors()
+{
+	if (nullptr != m_icon)
+	{
+		m_icon->refreshColors(QPaletteExt(QWidget::palette()), id());
+	}
+	update();
+}
+
+void QTopMenuButtonWidget::deferColorChanges( bool defer)
+{
+	if (nullptr != m_icon)
+	{
+		m_icon->deferColorChanges(defer, id());
+	}
+}
+
+void QTopMenuButtonWidget::pinIcons( bool pin)
+{
+	m_iconPinned = pin;
+	if (nullptr != m_icon)
+	{
+		m_icon->pinned(pin, id());
+	}
 }
 
 void QTopMenuButtonWidget::icon(QSvgIcon* ic)
@@ -493,6 +590,7 @@ void QTopMenuButtonWidget::icon(QSvgIcon* ic)
 	if (m_icon)
 	{
 		m_icon->declareId(id());
+		m_icon->pinned(m_iconPinned, id());
 	}
 
 	update();
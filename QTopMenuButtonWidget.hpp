@@ -20,6 +20,7 @@
 #define QTOPMENUBUTTONWIDGET_HPP
 
 #include <memory>
+#include <vector>
 
 #include <QStaticText>
 
@@ -56,6 +57,46 @@ struct QTopMenuButtonWidgetStyleOptions
 	qreal margin = 0.0;
 };
 
+/**
+ * @brief Candidate sizes of QTopMenuButtonWidget::bestSize
+ *
+ * Candidates only depend on the key (not on the widget): a QTopMenuButton shares one cache among all
+ * it widgets, so that each layout of many clones measures the label only once.
+ */
+class QTopMenuButtonSizeCache
+{
+public:
+	struct Key
+	{
+		DisplaySide direction;
+		qreal cellSize;
+		qreal cellMargin;
+		size_t transversalCellNum;
+		std::string label;
+		qreal margin;
+		QString font; // QFont::key()
+		size_t fontGeneration; // See QFontMetricsCache::generation
+		bool operator==( const Key& c) const;
+	};
+
+	/// Return the candidates for the key, nullptr if not cached
+	const std::vector<QSizeF>* find( const Key& key);
+	/// Store the candidates for the key. The reference is valid until the next insert or clear
+	const std::vector<QSizeF>& insert( Key key, std::vector<QSizeF> candidates);
+	/// Forget all candidates, e.g. when the label changes
+	void clear();
+
+	size_t hits() const { return m_hits; }
+	size_t misses() const { return m_misses; }
+
+private:
+	std::vector<std::pair<Key, std::vector<QSizeF>>> m_entries; // Few: directions x grid settings
+	size_t m_hits=0;
+	size_t m_misses=0;
+
+	static constexpr size_t MAX_ENTRIES = 8;
+};
+
 class QSvgIcon;
 
 class QTopMenuButtonWidget: public QTopMenuWidget
@@ -65,10 +106,14 @@ public:
 	explicit QTopMenuButtonWidget( const std::string& name, size_t id, QWidget* parent=nullptr);
 	virtual ~QTopMenuButtonWidget() override;
 
-	// See QTopMenuWidget for more details
+	// See QTopMenuWidget for more details. Candidates are memoized in sizeCache.
 	std::optional<QSizeF> bestSize(DisplaySide dir, const CellInfo& cellInfo,
 	    const QSizeF& sizeHint, const QSizeF& maxSize) const override;
 
+	/// Cache of bestSize candidates, shared with the other widgets of the same action
+	void sizeCache( std::shared_ptr<QTopMenuButtonSizeCache> cache);
+	const std::shared_ptr<QTopMenuButtonSizeCache>& sizeCache() const;
+
 	/// Icon accessors
 	virtual void icon(QSvgIcon* ic);
 	virtual const QSvgIcon* icon() const;
@@ -84,8 +129,14 @@ public:
 	using QTopMenuWidget::direction;
 	void direction( const DisplaySide d ) override;
 
+	// See QTopMenuWidget for more details
+	void prewarm() override;
+	void refreshColors() override;
+	void deferColorChanges( bool defer) override;
+	void pinIcons( bool pin) override;
+
 signals:
-	void clicked(const QPointF& cursorPos, const std::unordered_set<size_t>& clickableRectangleIds, QTopMenuButtonWidget* me); //TODO remove me argument
+	void clicked(const QPointF& cursorPos, const QClickIdSet& clickableRectangleIds, QTopMenuButtonWidget* me); //TODO remove me argument
 protected:
 
 	/// overridable call to the static equivalent, so it can be override by child classes.
@@ -99,7 +150,7 @@ protected:
 	//    virtual method allows child class to call another implementation of that static call
 	//    (because otherwise, internal implementation only call this static methdo, and never the override one.)
 	virtual QRect textRect() const;
-	static QRect textRect(const QRect& widgetRect, qreal margin, const QFontMetrics& metrics,
+	static QRect textRect(const QRect& widgetRect, qreal margin, const QFont& font,
 	    const QString& label, const QTopMenuBuggonWidgetLayout layout);
 
 	virtual QRectF iconRect() const;
@@ -108,11 +159,17 @@ protected:
 	virtual void setupFontForLabel( QFont& f) const { staticSetupFontForLabel(f); }
 	static void staticSetupFontForLabel( QFont& );
 
-	virtual QString elidedText( const QFontMetrics& metrics, const QTopMenuBuggonWidgetLayout layout,
+	/// Fonts are measured through QFontMetricsCache
+	virtual QString elidedText( const QFont& font, const QTopMenuBuggonWidgetLayout layout,
 	    const QString& str, const QSize& widgetSize, const qreal margin) const;
 
 	virtual void recomputeSize();
 
+	/// Sizes among which bestSize chooses, adjusted to the label. Pure function of it arguments,
+	///     the label and the margin (see QTopMenuButtonSizeCache)
+	virtual std::vector<QSizeF> candidateSizes( DisplaySide dir, const CellInfo& cellInfo,
+	    const QFont& font) const;
+
 
 	virtual QTopMenuBuggonWidgetLayout detectLayout(const QSize& size) const;
 
@@ -122,6 +179,7 @@ protected:
 
 	std::string m_label;
 	QSvgIcon* m_icon=nullptr;
+	bool m_iconPinned=false; // Applied to the icon, see pinIcons
 	qreal m_margin = 2.0;
 	QTopMenuBuggonWidgetLayout m_cachedLayout = QTopMenuBuggonWidgetLayout::Big;
 	QStaticText m_staticText;
@@ -130,6 +188,8 @@ protected:
 
 	bool m_recomputeSizeNeeded = true;
 
+	std::shared_ptr<QTopMenuButtonSizeCache> m_sizeCache = std::make_shared<QTopMenuButtonSizeCache>();
+
 	constexpr static qreal cornerRadius= 0.0;
 	constexpr static int borderWidth = 0.5;
 	
@@ -19,11 +19,21 @@
 #include "QTopMenuGrid.hpp"
 
 #include <QDebug> //TODO remove
+#include <QMetaMethod>
 
 using namespace Escain;
 
 QTopMenuGrid::QTopMenuGrid( QWidget* parent )
 	: QWidget(parent)
+	, m_layout(*this, [this](){ return runLayout(); }, [this]()
+	{
+		if (!isSignalConnected(QMetaMethod::fromSignal(&QTopMenuGrid::layoutRequested)))
+		{
+			return false; // Standalone grid: posted to itself
+		}
+		emit layoutRequested();
+		return true;
+	})
 {
 	setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
 	setFocusPolicy( Qt::FocusPolicy::StrongFocus);
@@ -95,13 +105,18 @@ bool QTopMenuGrid::addGroup(const QTopMenuGridGroup::Id& id, size_t pos)
 
 	connect(&(*insertedIt), &QTopMenuGridGroup::updateGeometryEvent, this, [this]()
 	{
-		m_needsRepositionGroup=true;
+		triggerRepositionGroups();
 		emit updateGeometryEvent();
 		update();
 	});
+	connect(&(*insertedIt), &QTopMenuGridGroup::layoutRequested, this, &QTopMenuGrid::scheduleLayout);
+	if (m_layout.updating())
+	{
+		insertedIt->beginUpdate(); // Ended with the others, see endUpdate
+	}
 
-	updateFocusOrder();
-	m_needsRepositionGroup = true;
+	m_focusChain.insert(static_cast<size_t>(std::distance(m_groupV.begin(), insertedIt)), &(*insertedIt));
+	triggerRepositionGroups();
 	
 	return true;
 }
@@ -115,11 +130,11 @@ bool QTopMenuGrid::removeGroup(const QTopMenuGridGroup::Id& groupId)
 		return false;
 	}
 
+	m_focusChain.remove(&(*it));
 	it->setParent(nullptr);
 	m_groupV.erase(it);
 
-	updateFocusOrder();
-	m_needsRepositionGroup = true;
+	triggerRepositionGroups();
 	emit updateGeometryEvent();
 	return true;
 }
@@ -143,7 +158,7 @@ void QTopMenuGrid::direction( DisplaySide d )
 			setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
 		}
 
-		m_needsRepositionGroup = true;
+		triggerRepositionGroups();
 		update();
 	}
 }
@@ -162,7 +177,7 @@ void QTopMenuGrid::transversalCellNum( size_t cellNum )
 		{
 			g.transversalCellNum(cellNum);
 		}
-		m_needsRepositionGroup = true;
+		triggerRepositionGroups();
 		update();
 	}
 }
@@ -181,7 +196,7 @@ void QTopMenuGrid::cellSize( qreal cellSize )
 		{
 			g.cellSize(cellSize);
 		}
-		m_needsRepositionGroup = true;
+		triggerRepositionGroups();
 		update();
 	}
 }
@@ -200,31 +215,132 @@ void QTopMenuGrid::margin( qreal margin )
 		{
 			g.margin(margin);
 		}
-		m_needsRepositionGroup = true;
+		triggerRepositionGroups();
 		update();
 	}
 }
 
-void QTopMenuGrid::paintEvent(QPaintEvent* e)
+void QTopMenuGrid::triggerRepositionGroups()
+{
+	m_needsRepositionGroup = true;
+	scheduleLayout();
+}
+
+void QTopMenuGrid::scheduleLayout()
+{
+	m_layout.schedule();
+}
+
+void QTopMenuGrid::beginUpdate()
 {
-	if (m_needsRepositionGroup)
+	if (!m_layout.beginUpdate())
 	{
-		repositionGroups();
+		return;
+	}
+	m_focusChain.linking(false); // Linked once at endUpdate
+	for (auto& group: m_groupV)
+	{
+		group.beginUpdate();
+	}
+}
+
+void QTopMenuGrid::endUpdate()
+{
+	if (!m_layout.endUpdate())
+	{
+		return; // Nested (or unbalanced with beginUpdate)
 	}
 
-	QWidget::paintEvent(e);
+	for (auto& group: m_groupV)
+	{
+		group.endUpdate();
+	}
+	m_focusChain.linking(true);
+	m_layout.flush();
 }
 
-void QTopMenuGrid::repositionGroups()
+bool QTopMenuGrid::runLayout()
 {
+	m_layout.inLayout(true);
+	bool done = false;
+	for (size_t round=0; round<MAX_LAYOUT_ROUNDS; ++round)
+	{
+		// Groups first: the grid position them from their size. Groups whose size did not change
+		// do not emit updateGeometryEvent, so the grid is not repositioned for them.
+		for (auto& g: m_groupV)
+		{
+			done = g.runLayout() || done;
+		}
+
+		if (!m_needsRepositionGroup)
+		{
+			break;
+		}
+		done = true;
+
+		if (isHidden())
+		{
+			// Hidden tab: the owner only needs the size contribution, place groups once shown
+			updateSizeContribution();
+			m_needsRepositionGroup = false;
+			m_needsPlacement = true;
+			continue;
+		}
+		repositionGroups(); // May (un)collapse groups, laid out in the next round
+	}
+	m_layout.inLayout(false);
+	return done;
+}
+
+bool QTopMenuGrid::event(QEvent* e)
+{
+	if (m_layout.event(e))
+	{
+		return true;
+	}
+	return QWidget::event(e);
+}
+
+void QTopMenuGrid::updateSizeContribution()
+{
+	// Minimum: all groups collapsed. Hint: all groups uncollapsed.
 	QSize minSize(0,0);
 	QSize maxSize(0,0);
+	for (const auto& g: m_groupV)
+	{
+		const QSize collapsed = g.collapsedSize();
+		const QSize uncollapsed = g.uncollapsedSize();
+		if (direction() == DisplaySide::Top)
+		{
+			maxSize = QSize(maxSize.width() + uncollapsed.width(), std::max(maxSize.height(), uncollapsed.height()));
+			minSize = QSize(minSize.width() + collapsed.width(), std::max(minSize.height(), collapsed.height()));
+		}
+		else
+		{
+			maxSize = QSize(std::max(maxSize.width(), uncollapsed.width()), maxSize.height() + uncollapsed.height());
+			minSize = QSize(std::max(minSize.width(), collapsed.width()), minSize.height() + collapsed.height());
+		}
+	}
 
-	std::function<qreal(std::list<QTopMenuGridGroup>::iterator& it, qreal prevPos)> positionGroup;
+	maxSize = maxSize.expandedTo(QSize(1,1)); // Max size can't be set to 0,0, avoid issues
+	if (minSize != minimumSize() || maxSize != maximumSize())
+	{
+		setMinimumSize(minSize);
+	}
+	if (maxSize != m_cachedSizeHint)
+	{
+		m_cachedSizeHint = maxSize;
+		updateGeometry();
+	}
+}
 
-	bool focusOrderNeedsUpdate=false;
+void QTopMenuGrid::repositionGroups()
+{
+	updateSizeContribution();
 
-	positionGroup = [this, &positionGroup, &minSize, &maxSize, &focusOrderNeedsUpdate]
+	std::function<qreal(std::list<QTopMenuGridGroup>::iterator& it, qreal prevPos)> positionGroup;
+
+	positionGroup = [this, &positionGroup]
 	(std::list<QTopMenuGridGroup>::iterator it, qreal prevPos) -> qreal
 	{
 		if (it == m_groupV.cend())
@@ -237,22 +353,7 @@ void QTopMenuGrid::repositionGroups()
 		QSize collapsed = it->collapsedSize();
 		QSize uncollapsed = it->uncollapsedSize();
 
-		qreal dirUncollapsedSize;
-		qreal dirCollapsedSize;
-		if (direction() == DisplaySide::Top)
-		{
-			dirUncollapsedSize = uncollapsed.width();
-			dirCollapsedSize = collapsed.width();
-			maxSize = QSize(maxSize.width() + dirUncollapsedSize, std::max(maxSize.height(), uncollapsed.height()));
-			minSize = QSize(minSize.width() + dirCollapsedSize, std::max(minSize.height(), collapsed.height()));
-		}
-		else
-		{
-			dirUncollapsedSize = uncollapsed.height();
-			dirCollapsedSize = collapsed.height();
-			maxSize = QSize(std::max(maxSize.width(), uncollapsed.width()), maxSize.height() + dirUncollapsedSize);
-			minSize = QSize(std::max(minSize.width(), collapsed.width()), minSize.height() + dirCollapsedSize);
-		}
+		const qreal dirUncollapsedSize = (dir == DisplaySide::Top ? uncollapsed.width() : uncollapsed.height());
 
 		auto nextIt = it;
 		nextIt++;
@@ -263,7 +364,6 @@ void QTopMenuGrid::repositionGroups()
 			if (!it->collapsed())
 			{
 				it->collapsed(true);
-				focusOrderNeedsUpdate = true;
 			}
 			sumSize -= (dir==DisplaySide::Top ? uncollapsed.width()-collapsed.width() : uncollapsed.height() - collapsed.height());
 			return sumSize;
@@ -272,7 +372,6 @@ void QTopMenuGrid::repositionGroups()
 		if (it->collapsed())
 		{
 			it->collapsed(false);
-			focusOrderNeedsUpdate = true;
 		}
 
 		return sumSize;
@@ -296,32 +395,14 @@ void QTopMenuGrid::repositionGroups()
 
 	}
 
-	maxSize = maxSize.expandedTo(QSize(1,1)); // Max size can't be set to 0,0, avoid issues
-	if (minSize != minimumSize() || maxSize != maximumSize())
-	{
-		setMinimumSize(minSize);
-	}
-	if (maxSize != m_cachedSizeHint)
-	{
-		m_cachedSizeHint = maxSize;
-		updateGeometry();
-	}
-
-	if (focusOrderNeedsUpdate)
-	{
-		updateFocusOrder(); //TODO check if needed after tabulation order is fixed
-	}
-
 	m_needsRepositionGroup = false;
+	m_needsPlacement = false;
 }
 
 QSize QTopMenuGrid::sizeHint() const
 {
-	if (m_needsRepositionGroup)
-	{
-		const_cast<QTopMenuGrid*>(this)->repositionGroups();
-
-	}
+	// Value of the layout pass, run now if pending (e.g. asked before the posted request)
+	m_layout.ensure();
 	return m_cachedSizeHint;
 }
 
@@ -342,36 +423,17 @@ QSize QTopMenuGrid::sizeHint() const
 }*/
 
 
-void QTopMenuGrid::updateFocusOrder()
+void QTopMenuGrid::resizeEvent(QResizeEvent*)
 {
-	//TODO a possible alternative for tabulation order, remove when fixed.
-	/*setFocusProxy(m_groupV.empty() ? nullptr : &(*m_groupV.begin()));
-	qDebug() << "entering group focus order"; //TODO remove
-	QWidget* w=this;
-	for (auto& gridGroup: m_groupV)
-	{
-		w = gridGroup.setTabulationOrder( w );
-	}
-	//setTabOrder(w, this);
-	qDebug() << "exiting group focus order"; //TODO remove
-
-	showOrder2(this);*/
-
-
-	QTopMenuGridGroup* prev = nullptr;
-	for (auto& gridGroup: m_groupV)
-	{
-		if (prev)
-		{
-			setTabOrder(prev, &gridGroup);
-		}
-		prev = &gridGroup;
-	}
+	triggerRepositionGroups();
 }
 
-void QTopMenuGrid::resizeEvent(QResizeEvent*)
+void QTopMenuGrid::showEvent(QShowEvent*)
 {
-	m_needsRepositionGroup = true;
+	if (m_needsPlacement)
+	{
+		triggerRepositionGroups(); // Laid out while hidden: only the size contribution is done
+	}
 }
 
 
@@ -21,6 +21,7 @@
 
 #include <QWidget>
 
+#include <QLayoutScheduler.hpp>
 #include <QPaletteExt.hpp>
 #include <QSvgIcon.hpp>
 #include <QTopMenuGridGroup.hpp>
@@ -80,30 +81,53 @@ public:
 	qreal margin() const;
 	virtual void margin( qreal margin );
 
-	/// See Qt sizeHint
+	/// See Qt sizeHint. The pending layout pass, if any, is run first (except while painting)
 	QSize sizeHint() const override;
 
+	/// Lay out the groups which changed, then reposition the groups if needed, until stable.
+	/// Normally called by the owner's layout pass (see layoutRequested), never while painting.
+	/// @return true if a layout was done
+	virtual bool runLayout();
+
+	/// Defer the focus order and layout work of the grid and all its groups until the matching
+	///     endUpdate, which does it once. Calls can be nested. See QTopMenu::beginUpdate.
+	void beginUpdate();
+	void endUpdate();
+
 signals:
 	void updateGeometryEvent();
+	/// The grid or one of its groups needs a layout pass. The owner (QTopMenu) runs it once for
+	///     all its children. If nothing is connected, the grid posts itself a LayoutRequest instead.
+	void layoutRequested();
 
 protected:
 	void resizeEvent(QResizeEvent*) override;
-	void paintEvent(QPaintEvent* e) override;
+	void showEvent(QShowEvent*) override;
+	bool event(QEvent* e) override;
 
 	virtual void repositionGroups();
+	/// Update the minimum size and sizeHint from the groups size, without placing them.
+	///     That is all the owner needs from a hidden grid.
+	void updateSizeContribution();
+	/// Set the groups to be repositioned in the next layout pass
+	void triggerRepositionGroups();
+	/// Request a layout pass before the next paint. Coalesced: several requests, one pass.
+	void scheduleLayout();
 
 private: 
-	/// Set the order of focus (tab order) between sub-widgets
-	virtual void updateFocusOrder();
-
 	size_t m_transversalCellNum = 3;              // Number of cells perpendicular to the direction
 	qreal m_cellSize = 20.0;                // Size of one-side of the cell (square)
 	qreal m_margin = 2.0;                   // margin between cells
 	DisplaySide m_direction = DisplaySide::Top;// direction of the grid (Horizontal, Vertical)
 
 	std::list<QTopMenuGridGroup> m_groupV; // The list of groups, and items/widgets
+	QFocusChain m_focusChain; // Order of focus (tab order) of the groups, same as m_groupV
 
 	bool m_needsRepositionGroup = true;
+	bool m_needsPlacement = false; // Size contribution updated while hidden, groups not placed yet
+	mutable QLayoutScheduler m_layout; // Forwarded to the owner, if any (mutable: sizeHint runs the pending pass)
+
+	static constexpr size_t MAX_LAYOUT_ROUNDS = 4; // Collapsing groups changes their size
 
 	QSize m_cachedSizeHint;
 };
@@ -20,8 +20,11 @@
 
 #include <cmath>
 
+#include <QFontMetricsCache.hpp>
+#include <QMetaMethod>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QPointer>
 
 #include "QTopMenuWidget.hpp"
 
@@ -57,12 +60,31 @@ const CellInfo& QTopMenuGridGroup::Item::originalCellInfo() const
 	return m_originalCellInfo;
 }
 
+const QPointF& QTopMenuGridGroup::Item::columnPos() const
+{
+	return m_columnPos;
+}
+
+void QTopMenuGridGroup::Item::columnPos( const QPointF& pos)
+{
+	m_columnPos = pos;
+}
+
 
 //*/////////////// QTopMenuGridGroup implementation //////////////
 
 QTopMenuGridGroup::QTopMenuGridGroup(  QWidget* parent )
 : QWidget(parent)
 , m_frame(this)
+, m_layout(*this, [this](){ return runLayout(); }, [this]()
+{
+	if (!isSignalConnected(QMetaMethod::fromSignal(&QTopMenuGridGroup::layoutRequested)))
+	{
+		return false; // Standalone group: posted to itself
+	}
+	emit layoutRequested();
+	return true;
+})
 {
 	setSizePolicy( QSizePolicy::Fixed, QSizePolicy::Fixed);
 	setFocusPolicy( Qt::StrongFocus);
@@ -105,7 +127,7 @@ QTopMenuGridGroup::QTopMenuGridGroup(  QWidget* parent )
 	});
 
 	connect(&m_clickManager, &QClickManager::clicked,
-	[this](const QPointF&, const std::unordered_set<size_t>&)
+	[this](const QPointF&, const QClickIdSet&)
 	{
 		togglePopup();
 	});
@@ -197,7 +219,7 @@ void QTopMenuGridGroup::label( const std::string_view& label )
 		m_label = label;
 		m_frame.label(label);
 		updateGeometry();
-		triggerResizeWidgets();
+		triggerRepositionWidgets(); // Only the label and the frame: widgets keep their size
 		update();
 	}
 }
@@ -206,6 +228,85 @@ void QTopMenuGridGroup::icon( const QSvgIcon& ico )
 {
 	m_icon = ico;
 	m_icon.margin(m_margin);
+	m_icon.pinned(m_iconsPinned);
+
+	// The rendering may finish after this group is destroyed
+	QPointer<QTopMenuGridGroup> self(this);
+	m_icon.rasterReady([self](size_t)
+	{
+		if (self)
+		{
+			self->update();
+		}
+	});
+}
+
+std::vector<std::shared_ptr<QTopMenuWidget>> QTopMenuGridGroup::widgets() const
+{
+	std::vector<std::shared_ptr<QTopMenuWidget>> result;
+	for (const auto& column: m_content)
+	{
+		for (const auto& item: column)
+		{
+			auto widget = item.widget().lock();
+			if (widget)
+			{
+				result.push_back(widget);
+			}
+		}
+	}
+	return result;
+}
+
+void QTopMenuGridGroup::prewarm()
+{
+	// Widgets, icon and arrow are sized by the layout, which may not be done yet for hidden tabs
+	runLayout();
+
+	const QPaletteExt pal(QWidget::palette());
+	if (m_icon.hasIcon())
+	{
+		m_icon.prewarm(pal, 0, devicePixelRatioF());
+	}
+
+	if (m_arrow.hasPixmap() && !m_arrow.size().isEmpty())
+	{
+		QPaletteExt groupPal = pal;
+		for (const auto group: {QPalette::Active, QPalette::Inactive, QPalette::Disabled})
+		{
+			groupPal.setCurrentColorGroup(group);
+			for (const auto role: {ColorRoleExt::LinesOverBackground_Normal,
+				ColorRoleExt::LinesOverBackground_Hover, ColorRoleExt::LinesOverBackground_Pressed})
+			{
+				m_arrow.pixmapFor(role, groupPal, 0, true, devicePixelRatioF());
+			}
+		}
+	}
+}
+
+void QTopMenuGridGroup::refreshColors()
+{
+	const QPaletteExt pal(QWidget::palette());
+	m_icon.refreshColors(pal);
+	m_arrow.refreshColors(pal);
+	update();
+}
+
+void QTopMenuGridGroup::deferColorChanges( bool defer)
+{
+	m_icon.deferColorChanges(defer);
+	m_arrow.deferColorChanges(defer);
+}
+
+void QTopMenuGridGroup::pinIcons( bool pin)
+{
+	m_iconsPinned = pin;
+	m_icon.pinned(pin);
+	m_arrow.pinned(pin);
+	for (const auto& widget: widgets())
+	{
+		widget->pinIcons(pin);
+	}
 }
 
 DisplaySide QTopMenuGridGroup::direction() const
@@ -381,13 +482,8 @@ QSize QTopMenuGridGroup::collapsedSize() const
 
 QSize QTopMenuGridGroup::uncollapsedSize() const
 {
-	if (m_needRepositionWidgets || m_needResizeWidgets)
-	{
-		// Even if we need to update caches to get the proper value, this function is
-		// a getter and we don't want it to be non-const.
-		const_cast<QTopMenuGridGroup*>(this)->repositionSubWidgets();
-	}
-
+	// Value of the layout pass, run now if pending (owners normally lay out their groups before)
+	m_layout.ensure();
 	const auto divWidth = (m_showDivisionBar ? divisionSpace : 0.0);
 	return m_frame.size() + transposeIfVert(m_direction, QSizeF(divWidth, 0.0)).toSize();
 }
@@ -450,6 +546,7 @@ void QTopMenuGridGroup::addItem( std::shared_ptr<QTopMenuWidget> widget, size_t
 	if(widgetLocked)
 	{
 		widgetLocked->setParent(static_cast<QWidget*>(&m_frame));
+		widgetLocked->pinIcons(m_iconsPinned);
 		connect (widgetLocked.get(), &QTopMenuWidget::fadePopup, this, [this]()
 		{
 			if (m_isCollapsed)
@@ -457,9 +554,10 @@ void QTopMenuGridGroup::addItem( std::shared_ptr<QTopMenuWidget> widget, size_t
 				fadePopup();
 			}
 		});
-		connect(widgetLocked.get(), &QTopMenuWidget::bestSizeChanged, this, [this]()
+		const QTopMenuWidget* changedWidget = widgetLocked.get();
+		connect(widgetLocked.get(), &QTopMenuWidget::bestSizeChanged, this, [this, changedWidget]()
 		{
-			triggerResizeWidgets();
+			triggerResizeColumn(changedWidget);
 		});
 	}
 	else
@@ -478,8 +576,8 @@ void QTopMenuGridGroup::addItem( std::shared_ptr<QTopMenuWidget> widget, size_t
 		}
 	}
 
-	// Update focus order for all the group
-	updateFocusOrder();
+	// Link the widget to its neighbours only
+	m_focusChain.insert(focusPos(column, heightPos), widgetLocked.get());
 
 	// Update widgets
 	triggerResizeWidgets();
@@ -492,26 +590,14 @@ void QTopMenuGridGroup::addItem(  std::shared_ptr<QTopMenuWidget> widget, size_t
 	addItem(widget, column, newColumn, heightPos, sizeHint);
 }
 
-void QTopMenuGridGroup::updateFocusOrder()
+size_t QTopMenuGridGroup::focusPos( size_t column, size_t heightPos) const
 {
-	QWidget* prev = nullptr;
-	for (size_t x=0; x<m_content.size(); ++x)
+	size_t pos = heightPos;
+	for (size_t x=0; x<column && x<m_content.size(); ++x)
 	{
-		for (size_t y=0; y<m_content[x].size(); ++y)
-		{
-			auto widgetLockIt = m_content[x][y].widget().lock();
-			if (!widgetLockIt)
-			{
-				assert(false);
-				throw std::runtime_error("Invalid widget in QTopMenuWidgetGrid");
-			}
-			if (prev)
-			{
-				setTabOrder(prev, widgetLockIt.get());
-			}
-			prev = widgetLockIt.get();
-		}
+		pos += m_content[x].size();
 	}
+	return pos;
 }
 
 void QTopMenuGridGroup::staticSetupFontForLabel( QFont& f)
@@ -567,6 +653,7 @@ bool QTopMenuGridGroup::removeItem( size_t column, size_t heightPos)
 	auto widgetLocked = itemList.at(heightPos).widget().lock();
 	if(widgetLocked)
 	{
+		m_focusChain.remove(widgetLocked.get());
 		widgetLocked->setParent(nullptr);
 	}
 
@@ -587,22 +674,63 @@ bool QTopMenuGridGroup::removeItem( size_t column, size_t heightPos)
 		}
 	}
 
-	// Update focus order for all the group
-	updateFocusOrder();
-
 	// Update widgets
 	triggerResizeWidgets();
 
 	return true;
 }
 
+void QTopMenuGridGroup::triggerResizeColumn( const QTopMenuWidget* widget)
+{
+	for (size_t x=0; x<m_content.size() && x<m_columnLayouts.size(); ++x)
+	{
+		for (const auto& item: m_content[x])
+		{
+			if (item.widget().lock().get() == widget)
+			{
+				m_columnLayouts[x].dirty = true;
+				triggerRepositionWidgets();
+				return;
+			}
+		}
+	}
+	triggerResizeWidgets(); // Not laid out yet
+}
+
 void QTopMenuGridGroup::repositionSubWidgets()
 {
 	qreal deltaX = m_margin; // Accumulated used space in this direction
 
+	if (m_needResizeWidgets || m_columnLayouts.size() != m_content.size())
+	{
+		m_columnLayouts.assign(m_content.size(), ColumnLayout{});
+	}
+
 	const qreal groupFrameHeight = sizeForCells(m_cellSize, m_margin, m_transversalCellNum);
 	for (size_t x=0; x<m_content.size(); ++x)
 	{
+		ColumnLayout& column = m_columnLayouts[x];
+		const qreal columnStart = deltaX;
+		if (!column.dirty)
+		{
+			// Same widgets and sizes: only shift the column if a previous one changed
+			if (column.offset != columnStart)
+			{
+				for (auto& item: m_content[x])
+				{
+					auto widgetLocked = item.widget().lock();
+					if (widgetLocked && !widgetLocked->isHidden()) // Hidden: no best size
+					{
+						const QPointF pos(columnStart + item.columnPos().x(), item.columnPos().y());
+						widgetLocked->move(transposeIfVert(m_direction, pos).toPoint());
+					}
+				}
+				column.offset = columnStart;
+			}
+			deltaX += column.extent;
+			continue;
+		}
+
 		qreal maxW = 0;     // Highest widget size in this direction
 		qreal deltaY = m_margin; // Accumulated used space in tranversal direction
 
@@ -613,7 +741,7 @@ void QTopMenuGridGroup::repositionSubWidgets()
 			// Resize Buttons inside
 			QSizeF widgetSize;
 			auto widgetLocked = item.widget().lock();
-			if (widgetLocked && m_needResizeWidgets)
+			if (widgetLocked)
 			{
 				// What would be an adequate Maximum Widget Size?
 				const QSizeF maxSize = transposeIfVert(m_direction, QSizeF(MAX_WIDTH, groupFrameHeight));
@@ -654,10 +782,6 @@ void QTopMenuGridGroup::repositionSubWidgets()
 				}
 				widgetSize = *bestWidgetSize;
 			}
-			else if (widgetLocked)
-			{
-				widgetSize = widgetLocked->size();
-			}
 			else
 			{
 				assert(false);
@@ -678,6 +802,7 @@ void QTopMenuGridGroup::repositionSubWidgets()
 				transposeIfVert(m_direction, newWidgetSize));
 
 			deltaY += newWidgetSize.height() + m_margin;
+			item.columnPos(QPointF(deltaX - columnStart, newWidgetPos.y()));
 
 			if (widgetLocked->pos() != newWidgetRect.topLeft().toPoint())
 			{
@@ -687,6 +812,9 @@ void QTopMenuGridGroup::repositionSubWidgets()
 
 		deltaX += maxW + m_margin;
 
+		column.offset = columnStart;
+		column.extent = deltaX - columnStart;
+		column.dirty = false;
 	}
 
 	// Set Text size, elide, and properties
@@ -695,13 +823,14 @@ void QTopMenuGridGroup::repositionSubWidgets()
 		auto maxSize = sizeForCells(m_cellSize, m_margin, m_transversalCellNum);
 		QFont font;
 		setupFontForLabel(font);
-		QFontMetrics metrics(font);
+		auto& measures = QFontMetricsCache::instance();
 		QString elidedLabel;
-		elidedLabel = metrics.elidedText(qLabel, Qt::TextElideMode::ElideMiddle, maxSize*2.0);
+		elidedLabel = measures.elidedText(font, qLabel, Qt::TextElideMode::ElideMiddle, maxSize*2.0);
 
-		if (metrics.height() != m_arrow.size().height())
+		const int labelHeight = qRound(measures.height(font));
+		if (labelHeight != m_arrow.size().height())
 		{
-			m_arrow.resize(QSize(metrics.height()*2, metrics.height()));
+			m_arrow.resize(QSize(labelHeight*2, labelHeight));
 		}
 
 		m_staticText.setText(elidedLabel); //TODO document utf8
@@ -728,7 +857,8 @@ void QTopMenuGridGroup::repositionSubWidgets()
 		newSize = collapsedSize();
 	}
 
-	if (newSize != size())
+	const QSize oldSize = size();
+	if (newSize != oldSize)
 	{
 		auto iconSize = collapsedIconRect().size();
 		m_icon.resize(iconSize);
@@ -737,7 +867,18 @@ void QTopMenuGridGroup::repositionSubWidgets()
 		setMaximumSize(newSize.toSize());
 		updateGeometry();
 	}
-	emit updateGeometryEvent(); // needed even if size did not changed -> e.g. collapsed need uncollapse
+
+	// The owner positions the groups from both sizes: e.g. a collapsed group may need to uncollapse
+	// when it content shrinks, even if the current size did not change
+	const QSize uncollapsed = uncollapsedSize();
+	const QSize collapsedS = collapsedSize();
+	if (newSize.toSize() != oldSize || uncollapsed != m_reportedUncollapsedSize ||
+		collapsedS != m_reportedCollapsedSize)
+	{
+		m_reportedUncollapsedSize = uncollapsed;
+		m_reportedCollapsedSize = collapsedS;
+		emit updateGeometryEvent();
+	}
 
 	// Set flags, so we know all is updated
 	m_needResizeWidgets = false;
@@ -826,6 +967,43 @@ void QTopMenuGridGroup::resizeEvent(QResizeEvent*)
 	triggerRepositionWidgets();
 }
 
+bool QTopMenuGridGroup::runLayout()
+{
+	if (!m_needRepositionWidgets && !m_needResizeWidgets)
+	{
+		return false;
+	}
+
+	m_layout.inLayout(true);
+	repositionSubWidgets();
+	m_layout.inLayout(false);
+	return true;
+}
+
+void QTopMenuGridGroup::scheduleLayout()
+{
+	m_layout.schedule();
+}
+
+void QTopMenuGridGroup::beginUpdate()
+{
+	if (m_layout.beginUpdate())
+	{
+		m_focusChain.linking(false); // Linked once at endUpdate
+	}
+}
+
+void QTopMenuGridGroup::endUpdate()
+{
+	if (!m_layout.endUpdate())
+	{
+		return; // Nested (or unbalanced with beginUpdate)
+	}
+
+	m_focusChain.linking(true);
+	m_layout.flush();
+}
+
 void QTopMenuGridGroup::staticDrawControl( const QTopMenuGridGroupStyleOptions& opt, QPainter& p)
 {
 	// Gather color for state/role
@@ -912,8 +1090,9 @@ void QTopMenuGridGroup::staticDrawControl( const QTopMenuGridGroupStyleOptions&
 		if (opt.arrow && opt.arrow->hasPixmap())
 		{
 			const auto& arrowR = arrowRect(opt.widgetRect, opt.cellInfo.margin, divSpace, *opt.arrow, opt.direction);
-			const auto& arrowPix = opt.arrow->pixmapFor(roleDrawing, opt.palette);
-			assert( arrowR.size() == arrowPix.size());
+			const qreal devicePixelRatio = p.device() ? p.device()->devicePixelRatioF() : 1.0;
+			const auto& arrowPix = opt.arrow->pixmapFor(roleDrawing, opt.palette, 0, true, devicePixelRatio);
+			assert( arrowR.size() == opt.arrow->size()); // arrowPix has size*devicePixelRatio pixels
 			p.drawPixmap(arrowR, arrowPix);
 		}
 
@@ -959,11 +1138,6 @@ void QTopMenuGridGroup::initStyleOption(QTopMenuGridGroupStyleOptions& opt) cons
 
 void QTopMenuGridGroup::paintEvent(QPaintEvent* e)
 {
-	if (m_needRepositionWidgets)
-	{
-		repositionSubWidgets();
-	}
-
 	QWidget::paintEvent(e);
 
 	QTopMenuGridGroupStyleOptions opt;
@@ -995,6 +1169,11 @@ void QTopMenuGridGroup::keyPressEvent(QKeyEvent *e)
 
 bool QTopMenuGridGroup::event(QEvent* e)
 {
+	if (m_layout.event(e))
+	{
+		return true;
+	}
+
 	if (m_isCollapsed)
 	{
 		auto ret = m_clickManager.eventHandler( e );
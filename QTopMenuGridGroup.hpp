@@ -26,6 +26,8 @@
 #include <QWidget>
 
 #include <QClickManager.hpp>
+#include <QFocusChain.hpp>
+#include <QLayoutScheduler.hpp>
 #include <QSvgIcon.hpp>
 
 #include "QTopMenuGridGroupPopup.hpp"
@@ -77,8 +79,12 @@ Q_OBJECT
 		const std::weak_ptr<QTopMenuWidget> widget() const;
 		const QSizeF& originalSizeHint() const;
 		const CellInfo& originalCellInfo() const;
+		/// Position (transposed) relative to the start of it column, set by the last layout
+		const QPointF& columnPos() const;
+		void columnPos( const QPointF& pos);
 	private:
 		std::weak_ptr<QTopMenuWidget> m_widget;
+		QPointF m_columnPos;
 
 		// Due to the size requirements of the m_widget, the desired sizeHint can actually not
 		//     be used as it is. But we want to keep that value for later uses.
@@ -174,6 +180,24 @@ public:
 	/// Set the collapsed icon
 	virtual void icon( const QSvgIcon& ico );
 
+	/// Return the widgets of the group, in the order they appear
+	std::vector<std::shared_ptr<QTopMenuWidget>> widgets() const;
+
+	/// Render in advance the collapsed icon and arrow for each state. See QTopMenuWidget::prewarm
+	virtual void prewarm();
+
+	/// Render again the collapsed icon and arrow already cached, whose colors changed with the
+	/// palette. See QTopMenuWidget::refreshColors
+	virtual void refreshColors();
+
+	/// Keep painting the previous colors of the collapsed icon and arrow until refreshColors.
+	///     Widgets are not affected. See QTopMenuWidget::deferColorChanges
+	virtual void deferColorChanges( bool defer);
+
+	/// Protect the collapsed icon, arrow and widget icons of this group from eviction (memory
+	/// budget). Widgets added later are pinned too. See QTopMenuWidget::pinIcons
+	virtual void pinIcons( bool pin);
+
 	/// See Qt sizeHint
 	QSize sizeHint() const override;
 
@@ -184,17 +208,36 @@ public:
 
 	/// Return the required size of the widget when collapsed.
 	virtual QSize collapsedSize() const;
-	/// Return the required size of the widget when uncollapsed
+	/// Return the required size of the widget when uncollapsed. The pending layout pass, if any, is
+	///     run first (except while painting)
 	virtual QSize uncollapsedSize() const;
 
 	QWidget* setTabulationOrder( QWidget* first);
+
+	/// Reposition (and resize) the sub-widgets now if any property changed since the last layout.
+	/// Normally called by the owner's layout pass (see layoutRequested), never while painting.
+	/// @return true if a layout was done
+	virtual bool runLayout();
+
+	/// Defer the focus order and layout work of the group until the matching endUpdate, which
+	///     does it once. Calls can be nested. See QTopMenu::beginUpdate.
+	void beginUpdate();
+	void endUpdate();
 signals:
 	void updateGeometryEvent();
+	/// The group needs a layout pass. The owner (QTopMenuGrid, QTopMenu) runs it once for all its
+	///     children. If nothing is connected, the group posts itself a LayoutRequest instead.
+	void layoutRequested();
 protected:
-	/// Set the widget to be recalculated for sub-widgets position
-	virtual void triggerRepositionWidgets() { m_needRepositionWidgets = true; }
+	/// Set the widget to be recalculated for sub-widgets position (in the next layout pass)
+	virtual void triggerRepositionWidgets() { m_needRepositionWidgets = true; scheduleLayout(); }
 	/// Set the widget to be recalculated for sub-widgets position AND size
 	virtual void triggerResizeWidgets() { triggerRepositionWidgets(); m_needResizeWidgets = true; }
+	/// Set only the widgets of the column containing widget to be resized, the following
+	///     columns are shifted (e.g. after a bestSizeChanged)
+	virtual void triggerResizeColumn( const QTopMenuWidget* widget);
+	/// Request a layout pass before the next paint. Coalesced: several requests, one pass.
+	void scheduleLayout();
 
 	/// Override of qt events
 	void paintEvent(QPaintEvent* e) override;
@@ -236,8 +279,8 @@ protected:
 	    const QSvgPixmapCache& arrow, DisplaySide dir);
 	virtual QRect arrowRect() const;
 
-	/// Update the order of TAB/shift+Tab for all sub-widgets
-	virtual void updateFocusOrder();
+	/// Position of the item in m_focusChain (column by column)
+	size_t focusPos( size_t column, size_t heightPos) const;
 
 	/// Convert a coordinate/size to it transposed if the widget is at left side (vertical)
 	static QPointF transposeIfVert(DisplaySide dir, const QPointF& p);
@@ -255,11 +298,25 @@ protected:
 	DisplaySide m_direction = DisplaySide::Top;// direction of the grid (Horizontal, Vertical)
 	bool m_needRepositionWidgets = true; // If the grid needs to re-compute widgets position before paint.
 	bool m_needResizeWidgets = true; // If the grid needs to re-compute the size of widgets.
+
+	/// Layout of a column of m_content, kept by repositionSubWidgets to only redo changed columns
+	struct ColumnLayout
+	{
+		bool dirty = true; // If the widgets of the column need to be resized
+		qreal offset = 0.0; // Start of the column in the direction
+		qreal extent = 0.0; // Space used by the column (and it overflow columns), margin included
+	};
+	std::vector<ColumnLayout> m_columnLayouts; // One per m_content column once laid out
+	QSize m_reportedUncollapsedSize; // Sizes when updateGeometryEvent was last emitted
+	QSize m_reportedCollapsedSize;
 	bool m_cacheHovered = false; // Save if the widget is hovered (for collapsed)
+	bool m_iconsPinned = false; // See pinIcons
+	mutable QLayoutScheduler m_layout; // Forwarded to the owner, if any (mutable: size getters run the pending pass)
 
 	QSvgIcon m_icon;
 	QSvgPixmapCache m_arrow;
 	QClickManager m_clickManager;
+	QFocusChain m_focusChain; // Order of TAB/shift+Tab of the widgets: updated per inserted/removed item
 	bool m_isCollapsed = false;
 	bool m_clickPressed = false;
 
@@ -18,6 +18,7 @@
 
 #include "QTopMenuGridGroupPopup.hpp"
 
+#include <QFontMetricsCache.hpp>
 #include <QPainter>
 #include <QPaintEvent>
 
@@ -100,15 +101,15 @@ void QTopMenuGridGroupPopup::prepareText()
 
 	QFont font;
 	setupFontForLabel(font);
-	QFontMetrics metrics(font);
+	auto& measures = QFontMetricsCache::instance();
 	QString elidedLabel;
 	if (direction()==DisplaySide::Top)
 	{
-		elidedLabel = metrics.elidedText(qLabel, Qt::TextElideMode::ElideMiddle, width()-2.0*m_margin);
+		elidedLabel = measures.elidedText(font, qLabel, Qt::TextElideMode::ElideMiddle, width()-2.0*m_margin);
 	}
 	else
 	{
-		elidedLabel = metrics.elidedText(qLabel, Qt::TextElideMode::ElideMiddle, height()-2.0*m_margin);
+		elidedLabel = measures.elidedText(font, qLabel, Qt::TextElideMode::ElideMiddle, height()-2.0*m_margin);
 	}
 
 	m_staticText.setText(elidedLabel);
@@ -22,33 +22,50 @@
 
 #include <QCoreApplication>	// Get current path for relative paths
 #include <QDir>				// Manage relative paths for loading
+#include <QMetaMethod>		// Check if an owner runs the layout pass
 #include <QPainter>			// Required to render the svg
 
+#include <QFontMetricsCache.hpp>
 #include <QPaletteExt.hpp>
 
 using namespace Escain;
 
 QTopMenuTab::QTopMenuTab( QWidget* parent )
 	: QWidget(parent)
+	, m_layout(*this, [this](){ return runLayout(); }, [this]()
+	{
+		if (!isSignalConnected(QMetaMethod::fromSignal(&QTopMenuTab::layoutRequested)))
+		{
+			return false; // Standalone tab bar: posted to itself
+		}
+		emit layoutRequested();
+		return true;
+	})
 	, m_underlineAnimator(this)
 {
 	m_clickManager.enableHover(*this);
+	m_clickManager.batchedHover(true);
 
-	connect( &m_clickManager, &QClickManager::hovered, this, [this]
-	(const QPointF&, bool hovered, const size_t clickId, const QRectF& rect)
+	// Sweeping the tab bar changes the hover of several tabs at once: a single scan and repaint
+	connect( &m_clickManager, &QClickManager::hoverChanged, this, [this]
+	(const QPoint&, const QClickIdSet& enteredIds, const QClickIdSet& leftIds, const QRect& changedRect)
 	{
 		for (auto& [id, tab]: m_tabs)
 		{
-			if (tab.m_clickableRectangleId == clickId)
+			if (enteredIds.contains(tab.m_clickableRectangleId))
 			{
-				tab.m_hovered = hovered;
+				tab.m_hovered = true;
+			}
+			else if (leftIds.contains(tab.m_clickableRectangleId))
+			{
+				tab.m_hovered = false;
 			}
 		}
-		update(rect.toRect());
+		update(changedRect);
 	});
 
 	connect( &m_clickManager, &QClickManager::pressed, this, [this]
-	(const QPointF&, bool pressed, const std::unordered_set<size_t>& clickableRectangleIds)
+	(const QPointF&, bool pressed, const QClickIdSet& clickableRectangleIds)
 	{
 		size_t clickId = 0;
 		if (pressed)
@@ -78,7 +95,7 @@ QTopMenuTab::QTopMenuTab( QWidget* parent )
 
 
 	connect( &m_clickManager, &QClickManager::clicked, this, [this]
-	(const QPointF& , const std::unordered_set<size_t>& clickableRectangleIds)
+	(const QPointF& , const QClickIdSet& clickableRectangleIds)
 	{
 		if (isEnabled())
 		{
@@ -164,6 +181,7 @@ bool QTopMenuTab::tabLabel( const Id& menuId, const std::string& label)
 			m_needUpdateTabLabelSizes = true;
 			m_needUpdateTabLabelPos = true;
 			m_needUpdateMinMaxSizes = true;
+			scheduleLayout();
 			update();
 		}
 		return true;
@@ -185,6 +203,7 @@ void QTopMenuTab::tabMargin( qreal margin )
 		m_needUpdateTabLabelSizes = true;
 		m_needUpdateTabLabelPos = true;
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -203,6 +222,7 @@ void QTopMenuTab::tabMinSizePercentil( qreal percentil )
 		m_needUpdateTabLabelSizes = true;
 		m_needUpdateTabLabelPos = true;
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -256,16 +276,16 @@ void QTopMenuTab::updateTabLabelSizes()
 	};
 
 	// Get the list of sizes for each tab text
+	QFont font;
+	setupFontForLabel(font);
+	auto& measures = QFontMetricsCache::instance();
 	std::vector<qreal> tabWidths(m_tabOrder.size());
 	for ( size_t i=0; i< m_tabOrder.size(); ++i)
 	{
 		Id id= m_tabOrder[i];
 		TopMenuTabItem& tab = m_tabs[id];
 
-		QFont font;
-		setupFontForLabel(font);
-		QFontMetrics metric(font);
-		tab.m_cacheLabelWidth = metric.horizontalAdvance(tab.m_label);
+		tab.m_cacheLabelWidth = measures.horizontalAdvance(font, tab.m_label);
 		tabWidths[i]=tab.m_cacheLabelWidth;
 	}
 
@@ -388,11 +408,18 @@ const QTopMenuTab::Id& QTopMenuTab::selectedId() const
 void QTopMenuTab::resizeEvent(QResizeEvent *)
 {
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 }
 
 
-void QTopMenuTab::paintEvent(QPaintEvent* e)
+bool QTopMenuTab::runLayout()
 {
+	if (!m_needUpdateTabLabelSizes && !m_needUpdateTabLabelPos && !m_needUpdateMinMaxSizes)
+	{
+		return false;
+	}
+
+	m_layout.inLayout(true);
 	if (m_needUpdateTabLabelSizes)
 	{
 		updateTabLabelSizes();
@@ -407,7 +434,17 @@ void QTopMenuTab::paintEvent(QPaintEvent* e)
 	{
 		updateMinMaxSizes();
 	}
+	m_layout.inLayout(false);
+	return true;
+}
 
+void QTopMenuTab::scheduleLayout()
+{
+	m_layout.schedule();
+}
+
+void QTopMenuTab::paintEvent(QPaintEvent* e)
+{
 	QWidget::paintEvent(e);
 	QPainter p(this);
 	p.setClipRect(e->rect());
@@ -532,6 +569,7 @@ void QTopMenuTab::direction(DisplaySide dir)
 		m_needUpdateTabLabelSizes = true;
 		m_needUpdateTabLabelPos = true;
 		m_needUpdateMinMaxSizes = true;
+		scheduleLayout();
 		update();
 	}
 }
@@ -587,6 +625,7 @@ bool QTopMenuTab::insertTab(const Id& id, const QString& name, int pos)
 	m_needUpdateTabLabelSizes = true;
 	m_needUpdateTabLabelPos = true;
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 	update();
 
 	return true;
@@ -627,6 +666,7 @@ bool QTopMenuTab::removeTab(const Id& id)
 	m_needUpdateTabLabelSizes = true;
 	m_needUpdateTabLabelPos = true;
 	m_needUpdateMinMaxSizes = true;
+	scheduleLayout();
 	update();
 
 	return true;
@@ -640,6 +680,11 @@ void QTopMenuTab::setupFontForLabel( QFont& f) const
 
 bool QTopMenuTab::event(QEvent* e)
 {
+	if (m_layout.event(e))
+	{
+		return true;
+	}
+
 	auto ret = m_clickManager.eventHandler( e );
 	if (ret)
 	{
@@ -651,12 +696,8 @@ bool QTopMenuTab::event(QEvent* e)
 
 QSize QTopMenuTab::sizeHint() const
 {
-	if (m_needUpdateMinMaxSizes)
-	{
-		// Cache needs to be updated, but sizeHint is still const
-		const_cast<QTopMenuTab*>(this)->updateMinMaxSizes();
-	}
-
+	// Value of the layout pass, run now if pending (e.g. asked before the posted request)
+	m_layout.ensure();
 	return m_cachedSizeHint;
 
 }
@@ -28,6 +28,7 @@
 #include <QWidget>
 
 #include <QClickManager.hpp>
+#include <QLayoutScheduler.hpp>
 #include "QTopMenuWidgetTypes.hpp"
 
 class QPainter;
@@ -109,13 +110,21 @@ public:
 	/// @return true if set properly (false if the menu does not exist)
 	virtual bool tabLabel( const Id& menuId, const std::string& label);
 
-	/// See Qt sizeHint
+	/// See Qt sizeHint. The pending layout pass, if any, is run first (except while painting)
 	QSize sizeHint() const override;
 
+	/// Update the tab label sizes, positions and the min/max size if any changed since the last
+	///     layout. Normally called by the owner's layout pass (see layoutRequested).
+	/// @return true if a layout was done
+	virtual bool runLayout();
+
 signals:
 	void tabChanged( const Id& prevSelected, const Id& newSelected);
 
 	void updateGeometryEvent();
+	/// The tabs need a layout pass. The owner (QTopMenu) runs it with the rest of the menu.
+	///     If nothing is connected, the widget posts itself a LayoutRequest instead.
+	void layoutRequested();
 	
 protected:
 
@@ -136,6 +145,9 @@ protected:
 	/// Setup the font to the proper size, weight, etc...
 	virtual void setupFontForLabel( QFont& f) const;
 
+	/// Request a layout pass before the next paint. Coalesced: several requests, one pass.
+	void scheduleLayout();
+
 	/// Convert a coordinate/size to it transposed if the widget is at left side (vertical)
 	static QPointF transposeIfVert(DisplaySide dir, const QPointF& p);
 	static QSizeF transposeIfVert(DisplaySide dir, const QSizeF& s);
@@ -179,6 +191,9 @@ protected:
 	///@brief cache sizeHint value
 	QSize m_cachedSizeHint = QSize(0,0);
 
+	///@brief coalesced layout requests, forwarded to the owner if any (mutable: sizeHint runs the pending pass)
+	mutable QLayoutScheduler m_layout;
+
 	QRect m_underlineAnimated;
 	QVariantAnimation m_underlineAnimator;
 
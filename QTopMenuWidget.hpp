@@ -63,6 +63,22 @@ public:
 	/// identifier of this widget among QTopMenuAction widgets
 	inline size_t id() const { return m_id; }
 
+	/// Render in advance the images this widget will need to paint (icons for each state), so
+	/// that the first paint, hover or press does not stall. By default, nothing to render.
+	virtual void prewarm() {}
+
+	/// Render again the images already cached by this widget, whose colors changed with the
+	/// palette. By default, nothing to render.
+	virtual void refreshColors() {}
+
+	/// Keep painting the previous colors after a palette change, until refreshColors (see
+	/// QTopMenu::refreshColors). By default, nothing to defer.
+	virtual void deferColorChanges( bool /*defer*/) {}
+
+	/// Protect the images of this widget from eviction (memory budget), e.g. while it is in the
+	/// visible tab. By default, nothing to protect.
+	virtual void pinIcons( bool /*pin*/) {}
+
 signals:
 	// After the interaction, this signal should be called to indicate the QTopMenu can fade the
 	// popup containing this widget (if collapsed).
@@ -45,12 +45,13 @@ int main (int argn, char *argv[])
 
 	menu.direction(Escain::DisplaySide::Top);
 
+	// Build the whole menu in one transaction: a single layout and focus order pass at endUpdate
+	menu.beginUpdate();
 	menu.insertTab("File", "&File");
 	menu.insertTab("Shape", "&Shape");
 	menu.insertTab("Solid", "S&olid");
 	menu.insertTab("CAM", "&CAM");
-	menu.addGroup("File", "File");
-	menu.addGroup("File", "Export");
+	menu.addGroups("File", {"File", "Export"});
 	menu.addGroup("Shape", "Shape");
 
 	menu.tabShortcut("Shape", QKeySequence(Qt::ALT + Qt::Key_S));
@@ -105,6 +106,7 @@ int main (int argn, char *argv[])
 
 	menu.addGenericItem(buttonSave.createWidget(),0, QSizeF(75, 75));
 	menu.addGenericItem(buttonOpen.createWidget(),1, QSizeF(120, 25));
+	menu.endUpdate();
 
 
 	window.resize(600,400);
@@ -0,0 +1,119 @@
+/*
+ * This file is part of Escain QTopMenu library
+ *
+ * QTopMenu library is free software: you can redistribute it and/or modify
+ * it under ther terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * Escain Documentor is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Adrian Maire escain (at) gmail.com
+ */
+
+// Check that QTopMenu coalesces its layout, counting the passes per change: a single change must
+// be laid out once, in the next event loop iteration, and painting must not lay out anything.
+// sizeHint, asked before the posted request, must run the pending pass instead of a stale value.
+
+#include <iostream>
+#include <string>
+
+#include <QApplication>
+
+#include "QTopMenu.hpp"
+#include "QTopMenuButton.hpp"
+
+using namespace Escain;
+
+namespace
+{
+size_t s_failures = 0;
+
+void check( bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ OK ] " : "[FAIL] ") << what << std::endl;
+	if (!condition)
+	{
+		++s_failures;
+	}
+}
+
+/// Layout passes run by the change and the following event loop iteration
+template<typename F>
+size_t passesFor( QTopMenu& menu, F change)
+{
+	const size_t before = menu.layoutPassCount();
+	change();
+	QApplication::processEvents();
+	return menu.layoutPassCount() - before;
+}
+}
+
+int main (int argn, char *argv[])
+{
+	QApplication app( argn, argv);
+
+	QTopMenu menu;
+	menu.direction(DisplaySide::Top);
+	menu.insertTab("File", "&File");
+	menu.addGroup("File", "File");
+
+	QTopMenuButton button;
+	button.label("Save");
+	menu.addItem("File", "File", button.createWidget(), 0, QSizeF(75, 75));
+
+	// No pass run yet: sizeHint runs it
+	const QSize initialHint = menu.sizeHint();
+	check(initialHint.height() > 0, "sizeHint before the first pass: height " +
+		std::to_string(initialHint.height()));
+
+	menu.resize(800, initialHint.height());
+	menu.show();
+	QApplication::processEvents(); // Settle the initial layout
+
+	size_t passes = passesFor(menu, [&](){ menu.addItem("File", "File", button.createWidget(), 1,
+		QSizeF(25, 25)); });
+	check(passes == 1, "addItem: " + std::to_string(passes) + " pass");
+
+	passes = passesFor(menu, [&](){ menu.grouplabel("File", "File", "Documents"); });
+	check(passes == 1, "group label change: " + std::to_string(passes) + " pass");
+
+	passes = passesFor(menu, [&](){ menu.resize(menu.width()+100, menu.height()); });
+	check(passes == 1, "resize: " + std::to_string(passes) + " pass");
+
+	// Several changes in the same event loop iteration
+	passes = passesFor(menu, [&]()
+	{
+		for (size_t i=0; i<10; ++i)
+		{
+			menu.addItem("File", "File", button.createWidget(), 2, QSizeF(25, 25));
+		}
+		menu.grouplabel("File", "File", "Files");
+	});
+	check(passes == 1, "10 addItem and a label change: " + std::to_string(passes) + " pass");
+
+	// Read right after the change: laid out now, not again by the posted request
+	QSize hint;
+	passes = passesFor(menu, [&]()
+	{
+		menu.addItem("File", "File", button.createWidget(), 3, QSizeF(75, 75));
+		hint = menu.sizeHint();
+	});
+	check(passes == 1, "addItem then sizeHint: " + std::to_string(passes) + " pass");
+	check(hint == menu.sizeHint(), "sizeHint after addItem is the laid out value");
+
+	passes = passesFor(menu, [&](){ menu.repaint(); });
+	check(passes == 0, "repaint: " + std::to_string(passes) + " pass");
+
+	passes = passesFor(menu, [&](){ menu.update(); });
+	check(passes == 0, "update: " + std::to_string(passes) + " pass");
+
+	std::cout << (s_failures==0 ? "All checks passed" : std::to_string(s_failures) + " checks failed") <<
+		std::endl;
+	return s_failures==0 ? 0 : 1;
+}